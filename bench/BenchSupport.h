@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <tins/tins.h>
+
+#include "Interface.h"
+#include "Utils.h"
+#include "RouteProgrammer.h"
+
+// Counts route changes without touching the system routing table
+class NullRouteProgrammer : public RouteProgrammer {
+public:
+    size_t added = 0, deleted = 0;
+
+    bool update(const Tins::IPv6Address &, const Interface &, bool isAdd) override {
+        (isAdd ? added : deleted)++;
+        return true;
+    }
+
+    bool updateBatch(const std::vector<Route> &routes, bool isAdd) override {
+        (isAdd ? added : deleted) += routes.size();
+        return true;
+    }
+};
+
+// Locally administered MAC addresses by ID
+inline Tins::HWAddress<6> makeMac(uint32_t id) {
+    uint8_t mac[6] = {0x02, 0x00, uint8_t(id >> 24), uint8_t(id >> 16), uint8_t(id >> 8), uint8_t(id)};
+    return Tins::HWAddress<6>(mac);
+}
+
+// Host addresses in 2001:db8::/64 by ID
+inline Tins::IPv6Address makeHostAddress(uint32_t id) {
+    auto address = Tins::IPv6Address("2001:db8::");
+    for (size_t i = 0; i < 4; i++) *(address.end() - 1 - i) = uint8_t(id >> (i * 8));
+    *(address.end() - 5) = 1; // Keep off the all-zero interface ID
+    return address;
+}
+
+// NA from a host behind the interface, solicited unicast to the interface or unsolicited multicast
+inline Tins::EthernetII makeHostAdvertisement(const Interface &to, const Tins::HWAddress<6> &hostMac, const Tins::IPv6Address &target, bool multicast) {
+    auto eth = Tins::EthernetII(multicast ? Tins::HWAddress<6>("33:33:00:00:00:01") : to.macAddress, hostMac);
+    auto ip6 = Tins::IPv6(multicast ? Tins::IPv6Address("ff02::1") : to.linkLocal, getLinkLocal(hostMac));
+    ip6.hop_limit(255);
+    auto icmp6 = Tins::ICMPv6(Tins::ICMPv6::NEIGHBOUR_ADVERT);
+    icmp6.target_addr(target);
+    icmp6.add_option(Tins::ICMPv6::option(Tins::ICMPv6::TARGET_ADDRESS, hostMac.address_size, hostMac.begin()));
+    icmp6.solicited(!multicast);
+    icmp6.override(true);
+    return eth / ip6 / icmp6;
+}
@@ -0,0 +1,666 @@
+// Emulates an upstream router and a population of SLAAC hosts around a running Magpie instance.
+// The generator owns the far ends of Magpie's links (veth or TAP, normally in a network
+// namespace): one upstream device facing Magpie's upstream interface, and one or more
+// downstream devices facing its downstream interfaces. Hosts answer the NS Magpie sends them,
+// and the router resolves hosts through Magpie, so every scenario runs the real daemon.
+
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <regex>
+#include <thread>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <tins/tins.h>
+#include <fmt/format.h>
+
+#include "ArgumentParser/ArgumentParser.h"
+#include "Logger.h"
+#include "Interface.h"
+#include "Metrics.h"
+#include "NDP.h"
+#include "BenchSupport.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Sends on one device. Hosts and the router share it, so sends are serialized
+class DeviceTransmitter : public Transmitter {
+    Tins::NetworkInterface device;
+    Tins::PacketSender sender;
+    std::mutex mutex;
+
+public:
+    std::atomic<uint64_t> packets = 0;
+
+    explicit DeviceTransmitter(const std::string &name) : device(name), sender(device) {}
+
+    void send(const Interface &, Tins::PDU &packet) override {
+        std::lock_guard lock(mutex);
+        sender.send(packet);
+        packets.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+// Line-based client of Magpie's control socket
+class ControlClient {
+    std::string path;
+
+public:
+    explicit ControlClient(const std::string &path) : path(path) {}
+
+    bool enabled() const {
+        return !path.empty();
+    }
+
+    // Response lines before "OK", or nullopt on error
+    std::optional<std::vector<std::string>> request(const std::string &line) {
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) return std::nullopt;
+
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+        auto request = line + "\n";
+        if (
+            connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+            write(fd, request.data(), request.size()) != (ssize_t)request.size()
+        ) {
+            close(fd);
+            return std::nullopt;
+        }
+
+        std::string buffer;
+        std::vector<std::string> lines;
+        char chunk[4096];
+        while (true) {
+            for (size_t newline; (newline = buffer.find('\n')) != std::string::npos; ) {
+                auto responseLine = buffer.substr(0, newline);
+                buffer.erase(0, newline + 1);
+                if (responseLine == "OK") {
+                    close(fd);
+                    return lines;
+                } else if (responseLine.rfind("ERROR", 0) == 0) {
+                    close(fd);
+                    return std::nullopt;
+                }
+                lines.push_back(responseLine);
+            }
+
+            auto size = read(fd, chunk, sizeof(chunk));
+            if (size <= 0) break;
+            buffer.append(chunk, size);
+        }
+
+        close(fd);
+        return std::nullopt;
+    }
+
+    std::optional<size_t> getRouteCount() {
+        auto lines = request("stats");
+        if (!lines) return std::nullopt;
+        for (const auto &line : *lines)
+            if (line.rfind("routes ", 0) == 0) return std::stoul(line.substr(7));
+        return std::nullopt;
+    }
+
+    // Interface name of the route, or empty if none
+    std::string getRouteInterface(const Tins::IPv6Address &address) {
+        auto lines = request("lookup " + address.to_string());
+        if (!lines || lines->empty()) return "";
+
+        // "route <address> dev <interface> ..."
+        static const std::regex re("^route \\S+ dev (\\S+)");
+        std::smatch match;
+        return std::regex_search(lines->front(), match, re) ? match[1].str() : "";
+    }
+};
+
+class LoadGenerator {
+public:
+    struct Host {
+        std::shared_ptr<Interface> interface; // For the NDP builders, carrying the host's MAC
+        size_t downstream;
+    };
+
+    struct Address {
+        size_t host;
+        bool alive;
+    };
+
+    struct Resolution {
+        Clock::time_point firstSent, lastSent;
+        size_t tries;
+    };
+
+    struct Statistics {
+        Histogram latency;
+        std::atomic<uint64_t> resolved = 0, failed = 0;
+        // NS from Magpie to the hosts
+        std::atomic<uint64_t> probes = 0, probesToGone = 0;
+    };
+
+    static constexpr auto RETRANSMIT_INTERVAL = std::chrono::seconds(1);
+    static constexpr size_t MAX_TRIES = 3;
+
+private:
+    std::shared_ptr<DeviceTransmitter> upstreamTransmitter;
+    std::vector<std::shared_ptr<DeviceTransmitter>> downstreamTransmitters;
+    std::vector<std::string> downstreamDevices;
+    std::string upstreamDevice;
+    std::unique_ptr<Interface> router;
+
+    std::mutex mutex;
+    std::vector<Host> hosts;
+    std::unordered_map<Tins::IPv6Address, Address> addresses;
+    std::unordered_map<Tins::IPv6Address, Resolution> pending;
+    uint32_t nextAddressId = 0;
+
+public:
+    std::mt19937 random{1};
+    std::unique_ptr<Statistics> statistics = std::make_unique<Statistics>();
+
+    LoadGenerator(const std::string &upstreamDevice, const std::vector<std::string> &downstreamDevices) :
+        downstreamDevices(downstreamDevices),
+        upstreamDevice(upstreamDevice)
+    {
+        upstreamTransmitter = std::make_shared<DeviceTransmitter>(upstreamDevice);
+        for (const auto &device : downstreamDevices)
+            downstreamTransmitters.push_back(std::make_shared<DeviceTransmitter>(device));
+        router = std::make_unique<Interface>("loadgen-router", makeMac(0xfe000000), upstreamTransmitter);
+    }
+
+    size_t getDownstreamCount() const {
+        return downstreamDevices.size();
+    }
+
+    size_t getPendingCount() {
+        std::lock_guard lock(mutex);
+        return pending.size();
+    }
+
+    uint64_t getSentPackets() const {
+        uint64_t packets = upstreamTransmitter->packets;
+        for (const auto &transmitter : downstreamTransmitters) packets += transmitter->packets;
+        return packets;
+    }
+
+    // Start a fresh set of counters for the next phase
+    void resetStatistics() {
+        std::lock_guard lock(mutex);
+        statistics = std::make_unique<Statistics>();
+    }
+
+    void startCapture() {
+        capture(upstreamDevice, "icmp6 and ip6[40] = 136", [this] (const Tins::PDU &pdu) { onUpstreamPacket(pdu); });
+        for (size_t i = 0; i < downstreamDevices.size(); i++)
+            capture(downstreamDevices[i], "icmp6 and ip6[40] = 135", [this, i] (const Tins::PDU &pdu) { onDownstreamPacket(i, pdu); });
+    }
+
+    // Hosts each get one address to begin with
+    void addHosts(size_t count) {
+        std::lock_guard lock(mutex);
+        for (size_t i = 0; i < count; i++) {
+            auto downstream = i % downstreamDevices.size();
+            auto interface = std::make_shared<Interface>("loadgen-host", makeMac(hosts.size()), downstreamTransmitters[downstream]);
+            hosts.push_back({interface, downstream});
+            addresses[makeHostAddress(nextAddressId++)] = {hosts.size() - 1, true};
+        }
+    }
+
+    std::vector<Tins::IPv6Address> getAliveAddresses() {
+        std::lock_guard lock(mutex);
+        std::vector<Tins::IPv6Address> result;
+        for (const auto &[address, info] : addresses)
+            if (info.alive) result.push_back(address);
+        return result;
+    }
+
+    // RFC 4941: a host gets a new temporary address and stops answering for the old one
+    Tins::IPv6Address rotateAddress(const Tins::IPv6Address &oldAddress) {
+        std::lock_guard lock(mutex);
+        auto &old = addresses.at(oldAddress);
+        old.alive = false;
+        auto newAddress = makeHostAddress(nextAddressId++);
+        addresses[newAddress] = {old.host, true};
+        return newAddress;
+    }
+
+    void setAlive(const Tins::IPv6Address &address, bool alive) {
+        std::lock_guard lock(mutex);
+        addresses.at(address).alive = alive;
+    }
+
+    // Move the host owning the address to the next downstream link, and announce it there
+    void moveHost(const Tins::IPv6Address &address) {
+        std::shared_ptr<Interface> interface;
+        {
+            std::lock_guard lock(mutex);
+            auto &host = hosts[addresses.at(address).host];
+            host.downstream = (host.downstream + 1) % downstreamDevices.size();
+            host.interface->transmitter = downstreamTransmitters[host.downstream];
+            interface = host.interface;
+        }
+
+        // Unsolicited NA to all nodes
+        auto packet = makeNeighborAdvertisement(*interface, Tins::HWAddress<6>("33:33:00:00:00:01"), Tins::IPv6Address("ff02::1"), address, false);
+        interface->send(packet, Metrics::NA);
+    }
+
+    // The router sends NS for the address and waits for NA from Magpie
+    void resolve(const Tins::IPv6Address &address) {
+        {
+            std::lock_guard lock(mutex);
+            auto now = Clock::now();
+            if (!pending.emplace(address, Resolution{now, now, 1}).second) return;
+        }
+
+        auto packet = makeNeighborSolicitation(*router, address);
+        router->send(packet, Metrics::NS);
+    }
+
+    // Retransmit unanswered NS, and give up after MAX_TRIES like a host's neighbor cache
+    void retransmit() {
+        std::vector<Tins::IPv6Address> retransmits;
+        {
+            std::lock_guard lock(mutex);
+            auto now = Clock::now();
+            for (auto it = pending.begin(); it != pending.end(); ) {
+                auto &resolution = it->second;
+                if (now - resolution.lastSent < RETRANSMIT_INTERVAL) {
+                    it++;
+                } else if (resolution.tries >= MAX_TRIES) {
+                    statistics->failed++;
+                    it = pending.erase(it);
+                } else {
+                    resolution.lastSent = now;
+                    resolution.tries++;
+                    retransmits.push_back(it->first);
+                    it++;
+                }
+            }
+        }
+
+        for (const auto &address : retransmits) {
+            auto packet = makeNeighborSolicitation(*router, address);
+            router->send(packet, Metrics::NS);
+        }
+    }
+
+private:
+    void capture(const std::string &device, const std::string &filter, std::function<void (const Tins::PDU &)> handler) {
+        Tins::SnifferConfiguration configuration;
+        configuration.set_filter(filter);
+        configuration.set_immediate_mode(true);
+        // Don't see our own packets
+        configuration.set_direction(PCAP_D_IN);
+        auto sniffer = std::make_shared<Tins::Sniffer>(device, configuration);
+
+        std::thread([sniffer, handler] {
+            for (auto &packet : *sniffer) {
+                try {
+                    handler(*packet.pdu());
+                } catch (const Tins::pdu_not_found &) {}
+            }
+        }).detach();
+    }
+
+    void onUpstreamPacket(const Tins::PDU &pdu) {
+        auto target = pdu.rfind_pdu<Tins::ICMPv6>().target_addr();
+
+        std::lock_guard lock(mutex);
+        auto it = pending.find(target);
+        if (it == pending.end()) return;
+
+        statistics->latency.record(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - it->second.firstSent).count());
+        statistics->resolved++;
+        pending.erase(it);
+    }
+
+    void onDownstreamPacket(size_t downstream, const Tins::PDU &pdu) {
+        const auto &eth = pdu.rfind_pdu<Tins::EthernetII>();
+        const auto &ip6 = pdu.rfind_pdu<Tins::IPv6>();
+        auto target = pdu.rfind_pdu<Tins::ICMPv6>().target_addr();
+
+        std::shared_ptr<Interface> interface;
+        {
+            std::lock_guard lock(mutex);
+            auto it = addresses.find(target);
+            if (it == addresses.end()) return;
+
+            statistics->probes++;
+            const auto &host = hosts[it->second.host];
+            if (!it->second.alive) {
+                statistics->probesToGone++;
+                return;
+            }
+            if (host.downstream != downstream) return;
+            interface = host.interface;
+        }
+
+        auto packet = makeNeighborAdvertisement(*interface, eth.src_addr(), ip6.src_addr(), target, true);
+        interface->send(packet, Metrics::NA);
+    }
+};
+
+struct Options {
+    std::string scenario;
+    std::string upstream;
+    std::vector<std::string> downstreams;
+    std::string controlSocket;
+    size_t hosts;
+    size_t rate;
+    size_t duration;
+    size_t churnRate;
+    size_t moveRate;
+    size_t gonePercent;
+    size_t routerRefresh;
+};
+
+// Resolve the addresses at the rate per second, and wait for all to finish
+static double resolveAll(LoadGenerator &generator, const std::vector<Tins::IPv6Address> &addresses, size_t rate) {
+    auto start = Clock::now();
+    for (size_t i = 0; i < addresses.size(); i++) {
+        auto due = start + std::chrono::microseconds(i * 1000000 / rate);
+        if (Clock::now() < due) std::this_thread::sleep_until(due);
+        generator.resolve(addresses[i]);
+        if (i % 64 == 0) generator.retransmit();
+    }
+
+    while (generator.getPendingCount() > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        generator.retransmit();
+    }
+
+    return secondsSince(start);
+}
+
+static void printResolutions(const LoadGenerator::Statistics &statistics) {
+    const auto &latency = statistics.latency;
+    fmt::print("resolutions       {} ok, {} failed\n", statistics.resolved.load(), statistics.failed.load());
+    if (latency.getCount() != 0) {
+        fmt::print(
+            "latency           p50 {:.2f} ms, p90 {:.2f} ms, p99 {:.2f} ms, max {:.2f} ms\n",
+            latency.percentile(0.5) / 1000.0, latency.percentile(0.9) / 1000.0,
+            latency.percentile(0.99) / 1000.0, latency.percentile(1) / 1000.0
+        );
+    }
+}
+
+static void printProbes(const LoadGenerator::Statistics &statistics, size_t hosts, double seconds) {
+    fmt::print(
+        "probe traffic     {} NS to hosts ({:.2f} per host per minute), {} to gone addresses\n",
+        statistics.probes.load(), statistics.probes * 60.0 / hosts / std::max(seconds, 1.0), statistics.probesToGone.load()
+    );
+}
+
+static void printRoutes(ControlClient &control) {
+    if (!control.enabled()) return;
+    if (auto routes = control.getRouteCount())
+        fmt::print("routes            {}\n", *routes);
+    else
+        fmt::print("routes            unknown, control socket request failed\n");
+}
+
+// Every host present, the router resolves each of them once
+static void runJoin(LoadGenerator &generator, ControlClient &control, const Options &options) {
+    fmt::print("== join: {} hosts, router resolving {} per second\n", options.hosts, options.rate);
+    generator.resetStatistics();
+    auto convergence = resolveAll(generator, generator.getAliveAddresses(), options.rate);
+    fmt::print("convergence       {:.3f} s\n", convergence);
+    printResolutions(*generator.statistics);
+    printProbes(*generator.statistics, options.hosts, convergence);
+    printRoutes(control);
+}
+
+// Periodic work during a timed scenario: the router refreshing known neighbors, and retransmits
+template <typename Step>
+static void runFor(LoadGenerator &generator, ControlClient &control, const Options &options, Step step) {
+    auto start = Clock::now();
+    auto refreshAddresses = generator.getAliveAddresses();
+    size_t refreshIndex = 0;
+    size_t maxRoutes = 0;
+    for (size_t second = 0; second < options.duration; second++) {
+        step(second);
+
+        // Spread the refreshes over the interval
+        size_t refreshes = options.routerRefresh ? refreshAddresses.size() / options.routerRefresh + 1 : 0;
+        for (size_t i = 0; i < refreshes && !refreshAddresses.empty(); i++) {
+            generator.resolve(refreshAddresses[refreshIndex++ % refreshAddresses.size()]);
+            if (refreshIndex % refreshAddresses.size() == 0) refreshAddresses = generator.getAliveAddresses();
+        }
+
+        auto due = start + std::chrono::seconds(second + 1);
+        while (Clock::now() < due) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            generator.retransmit();
+        }
+
+        if (control.enabled()) {
+            if (auto routes = control.getRouteCount()) maxRoutes = std::max(maxRoutes, *routes);
+        }
+    }
+
+    while (generator.getPendingCount() > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        generator.retransmit();
+    }
+
+    printResolutions(*generator.statistics);
+    printProbes(*generator.statistics, options.hosts, secondsSince(start));
+    if (control.enabled()) fmt::print("max routes        {}\n", maxRoutes);
+    printRoutes(control);
+}
+
+// Temporary addresses rotating, each new one resolved by the router once
+static void runChurn(LoadGenerator &generator, ControlClient &control, const Options &options) {
+    fmt::print("== churn: {} new temporary addresses per second for {} s\n", options.churnRate, options.duration);
+    generator.resetStatistics();
+    runFor(generator, control, options, [&] (size_t) {
+        auto alive = generator.getAliveAddresses();
+        std::shuffle(alive.begin(), alive.end(), generator.random);
+        for (size_t i = 0; i < options.churnRate && i < alive.size(); i++)
+            generator.resolve(generator.rotateAddress(alive[i]));
+    });
+}
+
+// Hosts moving to another downstream link, measured until Magpie's route follows
+static void runMove(LoadGenerator &generator, ControlClient &control, const Options &options) {
+    if (generator.getDownstreamCount() < 2 || !control.enabled()) {
+        LOGGER_ERROR("the move scenario needs two downstream devices and the control socket");
+        return;
+    }
+
+    fmt::print("== move: {} hosts moving per second for {} s\n", options.moveRate, options.duration);
+    generator.resetStatistics();
+    Histogram moveLatency;
+    size_t notFollowed = 0;
+    runFor(generator, control, options, [&] (size_t) {
+        auto alive = generator.getAliveAddresses();
+        std::shuffle(alive.begin(), alive.end(), generator.random);
+        for (size_t i = 0; i < options.moveRate && i < alive.size(); i++) {
+            auto before = control.getRouteInterface(alive[i]);
+            auto start = Clock::now();
+            generator.moveHost(alive[i]);
+
+            // Poll until the route changes interface
+            while (control.getRouteInterface(alive[i]) == before) {
+                if (secondsSince(start) > 1) {
+                    notFollowed++;
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            if (secondsSince(start) <= 1)
+                moveLatency.record(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count());
+        }
+    });
+
+    fmt::print(
+        "route follows     p50 {:.2f} ms, p99 {:.2f} ms, {} not within 1 s\n",
+        moveLatency.percentile(0.5) / 1000.0, moveLatency.percentile(0.99) / 1000.0, notFollowed
+    );
+}
+
+// A share of the hosts disappearing at once, measured until Magpie expires their routes
+static void runGone(LoadGenerator &generator, ControlClient &control, const Options &options) {
+    fmt::print("== gone: {}% of hosts disappearing, watching for {} s\n", options.gonePercent, options.duration);
+    generator.resetStatistics();
+
+    auto alive = generator.getAliveAddresses();
+    std::shuffle(alive.begin(), alive.end(), generator.random);
+    size_t gone = alive.size() * options.gonePercent / 100;
+    for (size_t i = 0; i < gone; i++) generator.setAlive(alive[i], false);
+
+    auto initialRoutes = control.enabled() ? control.getRouteCount() : std::nullopt;
+    auto start = Clock::now();
+    std::optional<double> expiredAfter;
+    runFor(generator, control, options, [&] (size_t) {
+        if (!initialRoutes || expiredAfter) return;
+        auto routes = control.getRouteCount();
+        if (routes && *routes + gone <= *initialRoutes) expiredAfter = secondsSince(start);
+    });
+
+    if (expiredAfter)
+        fmt::print("expired           all {} gone routes in {:.1f} s\n", gone, *expiredAfter);
+    else if (initialRoutes)
+        fmt::print("expired           not all {} gone routes within {} s\n", gone, options.duration);
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+    std::string downstreamList;
+    size_t logLevel;
+    ArgumentParser(argc, argv)
+        .setProgramDescription("Emulate a router and SLAAC hosts around a running Magpie, and report how it behaves.")
+        .addOption(
+            "scenario", "S",
+            "name",
+            "One of: join, churn, move, gone. Every scenario starts with the hosts joining.",
+            ArgumentParser::stringParser(options.scenario),
+            true, "join"
+        )
+        .addOption(
+            "upstream", "u",
+            "device",
+            "Device linked to Magpie's upstream interface, where the router is.",
+            ArgumentParser::stringParser(options.upstream),
+            false
+        )
+        .addOption(
+            "downstream", "d",
+            "list",
+            "Devices linked to Magpie's downstream interfaces (separated with ','), where the hosts are.",
+            ArgumentParser::stringParser(downstreamList),
+            false
+        )
+        .addOption(
+            "control-socket", "c",
+            "path",
+            "Magpie's control socket, to read the route table.",
+            ArgumentParser::stringParser(options.controlSocket),
+            true, ""
+        )
+        .addOption(
+            "hosts", "n",
+            "count",
+            "Number of hosts.",
+            ArgumentParser::integerParser(options.hosts),
+            true, "10000"
+        )
+        .addOption(
+            "rate", "r",
+            "count",
+            "Resolutions per second by the router when hosts join.",
+            ArgumentParser::integerParser(options.rate),
+            true, "1000"
+        )
+        .addOption(
+            "duration", "t",
+            "seconds",
+            "Duration of the churn, move and gone scenarios.",
+            ArgumentParser::integerParser(options.duration),
+            true, "60"
+        )
+        .addOption(
+            "churn-rate", "",
+            "count",
+            "New temporary addresses per second.",
+            ArgumentParser::integerParser(options.churnRate),
+            true, "100"
+        )
+        .addOption(
+            "move-rate", "",
+            "count",
+            "Hosts moving to another link per second.",
+            ArgumentParser::integerParser(options.moveRate),
+            true, "10"
+        )
+        .addOption(
+            "gone-percent", "",
+            "percent",
+            "Share of hosts disappearing.",
+            ArgumentParser::integerParser(options.gonePercent),
+            true, "10"
+        )
+        .addOption(
+            "router-refresh", "",
+            "seconds",
+            "Interval of the router resolving each host again in timed scenarios, 0 to disable.",
+            ArgumentParser::integerParser(options.routerRefresh),
+            true, "30"
+        )
+        .addOption(
+            "log-level", "l",
+            "level",
+            "Log level, 0 (error) to 4 (debug).",
+            ArgumentParser::integerParser(logLevel),
+            true, "0"
+        )
+        .parse();
+
+    Logger::initialize(static_cast<Logger::LogLevel>(std::min<size_t>(logLevel, Logger::DEBUG)));
+
+    std::regex re(",");
+    options.downstreams = std::vector<std::string>(
+        std::sregex_token_iterator(downstreamList.begin(), downstreamList.end(), re, -1),
+        std::sregex_token_iterator()
+    );
+    if (options.hosts == 0 || options.rate == 0) {
+        LOGGER_ERROR("hosts and rate must be positive");
+        return 1;
+    }
+
+    LoadGenerator generator(options.upstream, options.downstreams);
+    ControlClient control(options.controlSocket);
+    generator.addHosts(options.hosts);
+    generator.startCapture();
+
+    auto start = Clock::now();
+    runJoin(generator, control, options);
+    if (options.scenario == "churn") {
+        runChurn(generator, control, options);
+    } else if (options.scenario == "move") {
+        runMove(generator, control, options);
+    } else if (options.scenario == "gone") {
+        runGone(generator, control, options);
+    } else if (options.scenario != "join") {
+        LOGGER_ERROR("unknown scenario {}", options.scenario);
+        return 1;
+    }
+    fmt::print("== total\npackets sent      {} in {:.1f} s\n", generator.getSentPackets(), secondsSince(start));
+
+    Logger::flush();
+    return 0;
+}
@@ -0,0 +1,192 @@
+// Microbenchmarks of the primitives on the packet path. Use --benchmark_format=json or
+// --benchmark_out=<file> for machine-readable results.
+
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <tins/tins.h>
+
+#include "Interface.h"
+#include "NDP.h"
+#include "Queue.h"
+#include "RouteManager.h"
+#include "RequestManager.h"
+#include "Utils.h"
+#include "BenchSupport.h"
+
+class NullTransmitter : public Transmitter {
+public:
+    void send(const Interface &, Tins::PDU &) override {}
+};
+
+static std::shared_ptr<Interface> getInterface(size_t index) {
+    static std::vector<std::shared_ptr<Interface>> interfaces;
+    while (interfaces.size() <= index) {
+        auto name = "bench" + std::to_string(interfaces.size());
+        interfaces.push_back(Interface::initializeVirtual(name, makeMac(0xff000000 | interfaces.size()), std::make_shared<NullTransmitter>()));
+    }
+    return interfaces[index];
+}
+
+static void BM_MakeNeighborSolicitation(benchmark::State &state) {
+    auto interface = getInterface(0);
+    auto target = makeHostAddress(1);
+    for (auto _ : state) {
+        auto packet = makeNeighborSolicitation(*interface, target);
+        benchmark::DoNotOptimize(packet);
+    }
+}
+BENCHMARK(BM_MakeNeighborSolicitation);
+
+static void BM_MakeNeighborAdvertisement(benchmark::State &state) {
+    auto interface = getInterface(0);
+    auto target = makeHostAddress(1);
+    auto destMac = makeMac(1);
+    auto destIp = getLinkLocal(destMac);
+    for (auto _ : state) {
+        auto packet = makeNeighborAdvertisement(*interface, destMac, destIp, target, true);
+        benchmark::DoNotOptimize(packet);
+    }
+}
+BENCHMARK(BM_MakeNeighborAdvertisement);
+
+static void BM_SerializeNeighborAdvertisement(benchmark::State &state) {
+    auto interface = getInterface(0);
+    auto packet = makeNeighborAdvertisement(*interface, makeMac(1), getLinkLocal(makeMac(1)), makeHostAddress(1), true);
+    for (auto _ : state) {
+        auto data = packet.serialize();
+        benchmark::DoNotOptimize(data);
+    }
+}
+BENCHMARK(BM_SerializeNeighborAdvertisement);
+
+// The route table is shared by the benchmarks, holding the addresses 0 to count - 1. It's grown
+// or shrunk to the size of each run, whatever ran before
+static void fillRoutes(size_t count) {
+    static bool initialized = false;
+    if (!initialized) {
+        RouteManager::setRouteProgrammer(std::make_unique<NullRouteProgrammer>());
+        initialized = true;
+    }
+
+    for (size_t i = RouteManager::getRouteCount(); i > count; i--)
+        RouteManager::removeRoute(makeHostAddress(i - 1));
+
+    auto interface = getInterface(1);
+    for (size_t i = RouteManager::getRouteCount(); i < count; i++)
+        RouteManager::addOrRefreshRoute(makeHostAddress(i), interface);
+}
+
+static void BM_GetRoute(benchmark::State &state) {
+    size_t count = state.range(0);
+    fillRoutes(count);
+
+    std::mt19937 random(1);
+    std::vector<Tins::IPv6Address> targets;
+    for (size_t i = 0; i < 4096; i++) targets.push_back(makeHostAddress(random() % (count * 2))); // Half of them miss
+
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(RouteManager::getRoute(targets[i++ & 4095]));
+    }
+}
+BENCHMARK(BM_GetRoute)->Arg(1000)->Arg(100000)->Arg(1000000);
+
+static void BM_RefreshRoute(benchmark::State &state) {
+    size_t count = state.range(0);
+    fillRoutes(count);
+
+    std::mt19937 random(1);
+    std::vector<Tins::IPv6Address> targets;
+    for (size_t i = 0; i < 4096; i++) targets.push_back(makeHostAddress(random() % count));
+
+    auto interface = getInterface(1);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(RouteManager::addOrRefreshRoute(targets[i++ & 4095], interface));
+    }
+}
+BENCHMARK(BM_RefreshRoute)->Arg(1000)->Arg(100000)->Arg(1000000);
+
+// Many hosts asking for the same few targets, and asking again before answered
+static void BM_RequestAddDuplicates(benchmark::State &state) {
+    size_t requesters = state.range(0);
+    auto interface = getInterface(0);
+
+    size_t i = 0;
+    for (auto _ : state) {
+        auto requester = i % requesters;
+        RequestManager::addRequest(makeMac(requester), getLinkLocal(makeMac(requester)), makeHostAddress(i % 16), interface);
+        i++;
+    }
+
+    for (size_t target = 0; target < 16; target++)
+        RequestManager::matchAndRespond(makeHostAddress(target), [] (auto, auto, auto) {});
+}
+BENCHMARK(BM_RequestAddDuplicates)->Arg(1)->Arg(16)->Arg(256);
+
+// Add requests for one target from a number of hosts, then answer them all
+static void BM_RequestAddAndMatch(benchmark::State &state) {
+    size_t requesters = state.range(0);
+    auto interface = getInterface(0);
+    auto target = makeHostAddress(0);
+
+    size_t responded = 0;
+    for (auto _ : state) {
+        for (size_t requester = 0; requester < requesters; requester++)
+            RequestManager::addRequest(makeMac(requester), getLinkLocal(makeMac(requester)), target, interface);
+        RequestManager::matchAndRespond(target, [&] (auto, auto, auto) { responded++; });
+    }
+    state.SetItemsProcessed(responded);
+}
+BENCHMARK(BM_RequestAddAndMatch)->Arg(1)->Arg(16)->Arg(256);
+
+// One capture thread producing, the main loop consuming
+static void BM_QueuePushPop(benchmark::State &state) {
+    Queue<int> queue;
+    std::atomic<bool> stop = false;
+    std::thread producer([&] {
+        while (!stop.load(std::memory_order_relaxed)) {
+            // Stay ahead of the consumer without growing without bound
+            if (queue.size() < 1024) queue.push(1); else std::this_thread::yield();
+        }
+    });
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(queue.pop());
+    }
+
+    stop = true;
+    producer.join();
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_QueuePushPop)->UseRealTime();
+
+static void BM_IsLinkLocal(benchmark::State &state) {
+    auto addresses = {Tins::IPv6Address("fe80::1"), makeHostAddress(1)};
+    for (auto _ : state) {
+        for (const auto &address : addresses) benchmark::DoNotOptimize(isLinkLocal(address));
+    }
+}
+BENCHMARK(BM_IsLinkLocal);
+
+static void BM_GetLinkLocal(benchmark::State &state) {
+    auto mac = makeMac(1);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(getLinkLocal(mac));
+    }
+}
+BENCHMARK(BM_GetLinkLocal);
+
+static void BM_ToHex(benchmark::State &state) {
+    std::vector<uint8_t> data(state.range(0), 0xa5);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(toHex(data.data(), data.size()));
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_ToHex)->Arg(8)->Arg(64)->Arg(1024);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,275 @@
+// Feeds recorded or synthetic NDP traffic through the real packet processing, on virtual
+// interfaces with a recording transmitter and a route programmer that doesn't touch the system.
+// Runs on any Linux box without privileges.
+
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <regex>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <tins/tins.h>
+#include <fmt/format.h>
+
+#include "ArgumentParser/ArgumentParser.h"
+#include "Logger.h"
+#include "Interface.h"
+#include "Sniffer.h"
+#include "RouteManager.h"
+#include "PacketTrace.h"
+#include "NDP.h"
+#include "BenchSupport.h"
+
+static std::atomic<uint64_t> allocations = 0;
+
+void *operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    std::free(p);
+}
+
+class RecordingTransmitter : public Transmitter {
+public:
+    std::map<std::string, std::pair<size_t, size_t>> sent; // packets and bytes by interface
+
+    void send(const Interface &interface, Tins::PDU &packet) override {
+        // Serialize like a real send would
+        auto &[packets, bytes] = sent[interface.name];
+        packets++;
+        bytes += packet.serialize().size();
+    }
+};
+
+struct ReplayPacket {
+    std::shared_ptr<Interface> interface;
+    std::vector<uint8_t> data;
+};
+
+// Upstream routers resolving hosts, hosts answering or announcing themselves, and DU from the kernel
+static std::vector<ReplayPacket> makeSyntheticPackets(
+    size_t count,
+    size_t hosts,
+    uint32_t seed,
+    const std::vector<std::shared_ptr<Interface>> &interfaces,
+    std::shared_ptr<Transmitter> transmitter
+) {
+    std::mt19937 random(seed);
+    std::vector<ReplayPacket> packets;
+    packets.reserve(count);
+
+    // The router isn't registered, it's only for building packets
+    Interface router("bench-router", makeMac(0xffffffff), transmitter);
+    auto upstream = interfaces.front();
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t host = random() % hosts;
+        auto hostAddress = makeHostAddress(host);
+        auto hostMac = makeMac(host);
+        // Hosts live behind the downstream interfaces
+        auto downstream = interfaces[1 + host % (interfaces.size() - 1)];
+
+        auto kind = random() % 100;
+        if (kind < 50) {
+            auto packet = makeNeighborSolicitation(router, hostAddress);
+            packets.push_back({upstream, packet.serialize()});
+        } else if (kind < 90) {
+            // Solicited unicast NA mostly, unsolicited multicast NA sometimes
+            auto packet = makeHostAdvertisement(*downstream, hostMac, hostAddress, kind >= 85);
+            packets.push_back({downstream, packet.serialize()});
+        } else {
+            // DU on loopback, carrying the original IPv6 header whose destination is the host
+            auto original = Tins::IPv6(hostAddress, Tins::IPv6Address("2001:db8:ffff::1")) / Tins::RawPDU(std::vector<uint8_t>(8).data(), 8);
+            auto originalData = original.serialize();
+            auto icmp6 = Tins::ICMPv6(Tins::ICMPv6::DEST_UNREACHABLE);
+            icmp6.code(3);
+            auto packet = Tins::EthernetII() / Tins::IPv6("::1", "::1") / icmp6 / Tins::RawPDU(originalData.data(), originalData.size());
+            packets.push_back({Interface::getLoopback(), packet.serialize()});
+        }
+    }
+
+    return packets;
+}
+
+static std::vector<ReplayPacket> loadPcap(const std::string &path, std::shared_ptr<Interface> interface) {
+    std::vector<ReplayPacket> packets;
+    Tins::FileSniffer sniffer(path, "icmp6 and (ip6[40] = 135 or ip6[40] = 136 or ip6[40] = 1)");
+    for (auto &packet : sniffer) {
+        auto pdu = packet.pdu();
+        auto icmp6 = pdu->find_pdu<Tins::ICMPv6>();
+        if (!icmp6) continue;
+
+        // DU are captured on loopback
+        auto on = icmp6->type() == Tins::ICMPv6::DEST_UNREACHABLE ? Interface::getLoopback() : interface;
+        packets.push_back({on, pdu->serialize()});
+    }
+
+    return packets;
+}
+
+int main(int argc, char *argv[]) {
+    std::string pcapFile, pcapInterface, interfaceList;
+    size_t packetCount, hostCount, seed, logLevel;
+    ArgumentParser(argc, argv)
+        .setProgramDescription("Replay NDP traffic through Magpie's packet processing and report its performance.")
+        .addOption(
+            "pcap", "p",
+            "file",
+            "Replay packets from a pcap file instead of generating them.",
+            ArgumentParser::stringParser(pcapFile),
+            true, ""
+        )
+        .addOption(
+            "pcap-interface", "",
+            "name",
+            "The interface packets from the pcap file arrive on, the first one by default.",
+            ArgumentParser::stringParser(pcapInterface),
+            true, ""
+        )
+        .addOption(
+            "interfaces", "i",
+            "list",
+            "Names of virtual interfaces (separated with ','), the first one is upstream.",
+            ArgumentParser::stringParser(interfaceList),
+            true, "wan,lan"
+        )
+        .addOption(
+            "packets", "n",
+            "count",
+            "Number of synthetic packets.",
+            ArgumentParser::integerParser(packetCount),
+            true, "200000"
+        )
+        .addOption(
+            "hosts", "",
+            "count",
+            "Number of synthetic hosts.",
+            ArgumentParser::integerParser(hostCount),
+            true, "10000"
+        )
+        .addOption(
+            "seed", "",
+            "number",
+            "Seed of the synthetic traffic.",
+            ArgumentParser::integerParser(seed),
+            true, "1"
+        )
+        .addOption(
+            "log-level", "l",
+            "level",
+            "Log level, 0 (error) to 4 (debug).",
+            ArgumentParser::integerParser(logLevel),
+            true, "0"
+        )
+        .parse();
+
+    Logger::initialize(static_cast<Logger::LogLevel>(std::min<size_t>(logLevel, Logger::DEBUG)));
+    PacketTrace::initialize(0);
+
+    auto transmitter = std::make_shared<RecordingTransmitter>();
+    std::vector<std::shared_ptr<Interface>> interfaces;
+    std::regex re(",");
+    for (std::sregex_token_iterator it(interfaceList.begin(), interfaceList.end(), re, -1), end; it != end; it++)
+        interfaces.push_back(Interface::initializeVirtual(*it, makeMac(0xff000000 | interfaces.size()), transmitter));
+    if (interfaces.size() < 2) {
+        LOGGER_ERROR("at least two interfaces are needed");
+        return 1;
+    }
+
+    auto routeProgrammer = new NullRouteProgrammer();
+    RouteManager::setRouteProgrammer(std::unique_ptr<RouteProgrammer>(routeProgrammer));
+    // No timer, the replay is much faster than any interval
+    RouteManager::initialize(
+        0, 60, 5, "", RouteSnapshot::BINARY, 0, false, 0,
+        [] (Tins::IPv6Address address, std::shared_ptr<Interface> interface) {
+            auto newPacket = makeNeighborSolicitation(*interface, address);
+            interface->send(newPacket, Metrics::NS);
+        }
+    );
+
+    std::vector<ReplayPacket> packets;
+    if (!pcapFile.empty()) {
+        auto interface = interfaces.front();
+        if (!pcapInterface.empty()) {
+            auto it = Interface::interfaces.find(pcapInterface);
+            if (it == Interface::interfaces.end()) {
+                LOGGER_ERROR("unknown interface {}", pcapInterface);
+                return 1;
+            }
+            interface = it->second;
+        }
+        packets = loadPcap(pcapFile, interface);
+    } else {
+        packets = makeSyntheticPackets(packetCount, hostCount, seed, interfaces, transmitter);
+    }
+    if (packets.empty()) {
+        LOGGER_ERROR("no packets to replay");
+        return 1;
+    }
+
+    // Decoding is done by the capture threads, so it's excluded from the measurement. Packets
+    // are decoded in chunks to bound the memory
+    constexpr size_t CHUNK_SIZE = 4096;
+    std::chrono::steady_clock::duration elapsed = {};
+    uint64_t processAllocations = 0;
+    std::vector<std::unique_ptr<Tins::PDU>> decoded;
+    decoded.reserve(CHUNK_SIZE);
+    for (size_t chunk = 0; chunk < packets.size(); chunk += CHUNK_SIZE) {
+        auto chunkEnd = std::min(packets.size(), chunk + CHUNK_SIZE);
+        decoded.clear();
+        for (size_t i = chunk; i < chunkEnd; i++)
+            decoded.push_back(std::make_unique<Tins::EthernetII>(packets[i].data.data(), packets[i].data.size()));
+
+        auto allocationsBefore = allocations.load(std::memory_order_relaxed);
+        auto startTime = std::chrono::steady_clock::now();
+        for (size_t i = chunk; i < chunkEnd; i++)
+            Sniffer::process(packets[i].interface, *decoded[i - chunk], PacketTrace::now());
+        elapsed += std::chrono::steady_clock::now() - startTime;
+        processAllocations += allocations.load(std::memory_order_relaxed) - allocationsBefore;
+    }
+
+    auto seconds = std::chrono::duration<double>(elapsed).count();
+    fmt::print("packets          {}\n", packets.size());
+    fmt::print("elapsed          {:.3f} s\n", seconds);
+    fmt::print("throughput       {:.0f} packets/s\n", packets.size() / seconds);
+    fmt::print("allocations      {:.1f} per packet\n", double(processAllocations) / packets.size());
+    fmt::print("routes           {} in table, {} programmed, {} deleted\n", RouteManager::getRouteCount(), routeProgrammer->added, routeProgrammer->deleted);
+    for (const auto &[name, sent] : transmitter->sent)
+        fmt::print("sent [{}]{:<{}} {} packets, {} bytes\n", name, "", 10 - std::min<size_t>(10, name.length()), sent.first, sent.second);
+
+    fmt::print("\nlatency from dequeue, microseconds (p50 / p99 / p99.9)\n");
+    fmt::print("{:<4} {:<10} {:>9}", "type", "outcome", "count");
+    for (size_t stage = PacketTrace::DECIDED; stage < PacketTrace::STAGE_COUNT; stage++)
+        fmt::print("  {:>24}", PacketTrace::STAGE_NAMES[stage]);
+    fmt::print("\n");
+    for (size_t type = 0; type < Metrics::MESSAGE_TYPE_COUNT; type++) {
+        for (size_t outcome = 0; outcome < PacketTrace::OUTCOME_COUNT; outcome++) {
+            const auto &stages = PacketTrace::latency[type][outcome];
+            if (stages[PacketTrace::DEQUEUED].getCount() == 0) continue;
+
+            fmt::print("{:<4} {:<10} {:>9}", Metrics::MESSAGE_TYPE_NAMES[type], PacketTrace::OUTCOME_NAMES[outcome], stages[PacketTrace::DEQUEUED].getCount());
+            for (size_t stage = PacketTrace::DECIDED; stage < PacketTrace::STAGE_COUNT; stage++) {
+                const auto &histogram = stages[stage];
+                if (histogram.getCount() == 0)
+                    fmt::print("  {:>24}", "-");
+                else
+                    fmt::print("  {:>24}", fmt::format("{} / {} / {}", histogram.percentile(0.5), histogram.percentile(0.99), histogram.percentile(0.999)));
+            }
+            fmt::print("\n");
+        }
+    }
+
+    Logger::flush();
+    return 0;
+}
@@ -0,0 +1,448 @@
+// Runs the real packet processing, route expiry and request tracking against a simulated router
+// and host population on virtual interfaces, in virtual time. Hosts rotate temporary addresses
+// and leave, the router keeps resolving them, and every route deletion is checked against the
+// time the address really disappeared. Days of network time run in seconds, without privileges.
+
+#include <cstdio>
+#include <chrono>
+#include <random>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <tins/tins.h>
+#include <fmt/format.h>
+
+#include "ArgumentParser/ArgumentParser.h"
+#include "Logger.h"
+#include "Clock.h"
+#include "Interface.h"
+#include "Sniffer.h"
+#include "RouteManager.h"
+#include "PacketTrace.h"
+#include "Metrics.h"
+#include "NDP.h"
+#include "BenchSupport.h"
+
+// Arbitrary, but fixed so runs are reproducible
+constexpr time_t SIMULATION_START = 1700000000;
+
+// Hosts behind the downstream interface, each owning a fixed number of address slots. An address
+// ID is never reused, so a route can always be told apart from a later address in the same slot
+class Population {
+    struct Address {
+        uint32_t slot;
+        // 0 while alive
+        time_t diedAt;
+    };
+
+    size_t addressesPerHost;
+    time_t addressLifetime;
+    std::mt19937 random;
+
+    std::vector<uint32_t> hostMacs;
+    std::vector<uint32_t> slotAddresses;
+    std::vector<Address> addresses;
+    uint32_t nextMac = 0;
+
+    // Addresses the router re-resolves on each step, by ID modulo the bucket count
+    std::vector<std::vector<uint32_t>> refreshBuckets;
+    // Temporary addresses by expiration, in order as the lifetime is fixed
+    std::deque<std::pair<time_t, uint32_t>> rotations;
+
+    uint32_t addAddress(uint32_t slot, time_t expireAt) {
+        uint32_t id = addresses.size();
+        addresses.push_back({slot, 0});
+        slotAddresses[slot] = id;
+        refreshBuckets[id % refreshBuckets.size()].push_back(id);
+        if (addressLifetime != 0) rotations.emplace_back(expireAt, id);
+        return id;
+    }
+
+    void retire(uint32_t id, time_t now) {
+        addresses[id].diedAt = now;
+        retired++;
+    }
+
+public:
+    size_t rotated = 0, departed = 0, retired = 0;
+
+    Population(size_t hosts, size_t addressesPerHost, size_t buckets, time_t addressLifetime, uint32_t seed)
+        : addressesPerHost(addressesPerHost), addressLifetime(addressLifetime), random(seed),
+          hostMacs(hosts), slotAddresses(hosts * addressesPerHost), refreshBuckets(buckets) {
+        addresses.reserve(hosts * addressesPerHost);
+        for (auto &mac : hostMacs) mac = nextMac++;
+
+        // Spread the first rotations over a lifetime, as if the hosts had been up for a while
+        for (uint32_t slot = 0; slot < slotAddresses.size(); slot++)
+            addAddress(slot, SIMULATION_START + 1 + (addressLifetime ? random() % addressLifetime : 0));
+        std::sort(rotations.begin(), rotations.end());
+    }
+
+    size_t getHostCount() const {
+        return hostMacs.size();
+    }
+
+    size_t getAddressCount() const {
+        return addresses.size();
+    }
+
+    std::optional<uint32_t> find(const Tins::IPv6Address &address) const {
+        uint32_t id = 0;
+        for (size_t i = 0; i < 4; i++) id |= uint32_t(*(address.end() - 1 - i)) << (i * 8);
+        if (id >= addresses.size() || makeHostAddress(id) != address) return std::nullopt;
+        return id;
+    }
+
+    bool isAlive(uint32_t id) const {
+        return addresses[id].diedAt == 0;
+    }
+
+    time_t getDiedAt(uint32_t id) const {
+        return addresses[id].diedAt;
+    }
+
+    Tins::HWAddress<6> getMac(uint32_t id) const {
+        return makeMac(hostMacs[addresses[id].slot / addressesPerHost]);
+    }
+
+    // Replace the expired temporary addresses
+    void rotate(time_t now) {
+        while (!rotations.empty() && rotations.front().first <= now) {
+            auto id = rotations.front().second;
+            rotations.pop_front();
+            if (!isAlive(id)) continue;
+
+            retire(id, now);
+            addAddress(addresses[id].slot, now + addressLifetime);
+            rotated++;
+        }
+    }
+
+    // A random host leaves, and a new one with new addresses takes its place
+    void depart(time_t now) {
+        uint32_t host = random() % hostMacs.size();
+        hostMacs[host] = nextMac++;
+        for (uint32_t slot = host * addressesPerHost; slot < (host + 1) * addressesPerHost; slot++) {
+            retire(slotAddresses[slot], now);
+            addAddress(slot, now + addressLifetime);
+        }
+        departed++;
+    }
+
+    // Call the callback for alive addresses in the bucket, dropping the dead ones
+    template <typename Callback>
+    void visitBucket(size_t step, Callback &&callback) {
+        auto &bucket = refreshBuckets[step % refreshBuckets.size()];
+        bucket.erase(std::remove_if(bucket.begin(), bucket.end(), [&] (uint32_t id) { return !isAlive(id); }), bucket.end());
+        for (auto id : bucket) callback(id);
+    }
+};
+
+// Checks each route deletion against the population. Deletion delays are recorded in seconds
+class CheckingRouteProgrammer : public RouteProgrammer {
+    const Population &population;
+    time_t bound;
+
+    void record(const Tins::IPv6Address &address, bool isAdd) {
+        if (finished) return;
+        if (isAdd) {
+            added++;
+            return;
+        }
+
+        deleted++;
+        auto id = population.find(address);
+        if (!id) {
+            unknown++;
+        } else if (population.isAlive(*id)) {
+            deletedAlive++;
+        } else {
+            auto delay = Clock::now() - population.getDiedAt(*id);
+            expiryDelay.record(delay);
+            if (delay > bound) late++;
+        }
+    }
+
+public:
+    size_t added = 0, deleted = 0, deletedAlive = 0, late = 0, unknown = 0;
+    Histogram expiryDelay;
+    // Set before exiting, the routes are all deleted on exit
+    bool finished = false;
+
+    // Deleting a route later than the bound after its address is gone is late
+    CheckingRouteProgrammer(const Population &population, time_t bound) : population(population), bound(bound) {}
+
+    bool update(const Tins::IPv6Address &address, const Interface &, bool isAdd) override {
+        record(address, isAdd);
+        return true;
+    }
+
+    bool updateBatch(const std::vector<Route> &routes, bool isAdd) override {
+        for (const auto &[address, _] : routes) record(address, isAdd);
+        return true;
+    }
+};
+
+// Answers the NS sent to the hosts and counts the NA sent to the router. The answers are queued
+// and processed after the current packet or timer, like captured packets would be
+class SimulatedTransmitter : public Transmitter {
+public:
+    const Population *population = nullptr;
+    std::shared_ptr<Interface> upstream, downstream;
+    std::deque<Tins::EthernetII> answers;
+    size_t nsToHosts = 0, nsToRouter = 0, naToHosts = 0, naToRouter = 0;
+
+    void send(const Interface &interface, Tins::PDU &packet) override {
+        auto icmp6 = packet.find_pdu<Tins::ICMPv6>();
+        if (!icmp6) return;
+
+        bool isNs = icmp6->type() == Tins::ICMPv6::NEIGHBOUR_SOLICIT;
+        if (&interface == upstream.get()) {
+            (isNs ? nsToRouter : naToRouter)++;
+            return;
+        }
+
+        (isNs ? nsToHosts : naToHosts)++;
+        if (!isNs) return;
+
+        auto target = icmp6->target_addr();
+        if (auto id = population->find(target); id && population->isAlive(*id))
+            answers.push_back(makeHostAdvertisement(interface, population->getMac(*id), target, false));
+    }
+
+    void deliverAnswers() {
+        while (!answers.empty()) {
+            auto packet = std::move(answers.front());
+            answers.pop_front();
+            Sniffer::process(downstream, packet, PacketTrace::now());
+        }
+    }
+};
+
+static long getRssKilobytes() {
+    long pages = 0;
+    if (auto file = fopen("/proc/self/statm", "r")) {
+        if (fscanf(file, "%*ld %ld", &pages) != 1) pages = 0;
+        fclose(file);
+    }
+    return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+int main(int argc, char *argv[]) {
+    size_t hostCount, addressesPerHost, duration, step, routerRefresh, addressLifetime, departureRate;
+    size_t checkInterval, probeInterval, probeRetries, reportInterval, seed, logLevel;
+    ArgumentParser(argc, argv)
+        .setProgramDescription("Simulate a network around Magpie in virtual time and check its route expiry.")
+        .addOption(
+            "hosts", "n",
+            "count",
+            "Number of hosts behind the downstream interface.",
+            ArgumentParser::integerParser(hostCount),
+            true, "10000"
+        )
+        .addOption(
+            "addresses", "",
+            "count",
+            "Number of addresses of each host.",
+            ArgumentParser::integerParser(addressesPerHost),
+            true, "2"
+        )
+        .addOption(
+            "duration", "t",
+            "seconds",
+            "Simulated time.",
+            ArgumentParser::integerParser(duration),
+            true, "86400"
+        )
+        .addOption(
+            "step", "",
+            "seconds",
+            "Granularity of the router and host activity.",
+            ArgumentParser::integerParser(step),
+            true, "10"
+        )
+        .addOption(
+            "router-refresh", "",
+            "seconds",
+            "The interval the router re-resolves each address in.",
+            ArgumentParser::integerParser(routerRefresh),
+            true, "1200"
+        )
+        .addOption(
+            "address-lifetime", "",
+            "seconds",
+            "Lifetime of temporary addresses, 0 to keep addresses.",
+            ArgumentParser::integerParser(addressLifetime),
+            true, "86400"
+        )
+        .addOption(
+            "departures", "",
+            "count",
+            "Hosts leaving per hour, each replaced by a new host.",
+            ArgumentParser::integerParser(departureRate),
+            true, "100"
+        )
+        .addOption(
+            "alarm-interval", "a",
+            "seconds",
+            "Magpie's interval to check and reprobe routes.",
+            ArgumentParser::integerParser(checkInterval),
+            true, "10"
+        )
+        .addOption(
+            "probe-interval", "p",
+            "seconds",
+            "Magpie's interval of timeout to reprobe a route.",
+            ArgumentParser::integerParser(probeInterval),
+            true, "60"
+        )
+        .addOption(
+            "probe-retries", "r",
+            "count",
+            "Magpie's max retries of reprobing before deleting a route.",
+            ArgumentParser::integerParser(probeRetries),
+            true, "5"
+        )
+        .addOption(
+            "report-interval", "",
+            "seconds",
+            "Simulated time between progress lines, 0 to disable.",
+            ArgumentParser::integerParser(reportInterval),
+            true, "3600"
+        )
+        .addOption(
+            "seed", "",
+            "number",
+            "Seed of the population.",
+            ArgumentParser::integerParser(seed),
+            true, "1"
+        )
+        .addOption(
+            "log-level", "l",
+            "level",
+            "Log level, 0 (error) to 4 (debug).",
+            ArgumentParser::integerParser(logLevel),
+            true, "0"
+        )
+        .parse();
+
+    if (hostCount == 0 || addressesPerHost == 0 || step == 0 || checkInterval == 0) {
+        fmt::print(stderr, "hosts, addresses, step and alarm interval must be positive\n");
+        return 1;
+    }
+
+    Logger::initialize(static_cast<Logger::LogLevel>(std::min<size_t>(logLevel, Logger::DEBUG)));
+    PacketTrace::initialize(0);
+    Clock::setVirtual(SIMULATION_START);
+
+    auto setupStart = std::chrono::steady_clock::now();
+    Population population(hostCount, addressesPerHost, std::max<size_t>(1, routerRefresh / step), addressLifetime, seed);
+
+    auto transmitter = std::make_shared<SimulatedTransmitter>();
+    transmitter->population = &population;
+    transmitter->upstream = Interface::initializeVirtual("wan", makeMac(0xff000000), transmitter);
+    transmitter->downstream = Interface::initializeVirtual("lan", makeMac(0xff000001), transmitter);
+    // The router isn't registered, it's only for building packets
+    Interface router("sim-router", makeMac(0xffffffff), transmitter);
+
+    // A route is probed after the probe interval, then on each retry, all delayed by up to an alarm interval
+    auto bound = (time_t)((probeInterval + checkInterval) * (probeRetries + 1));
+    auto routeProgrammer = new CheckingRouteProgrammer(population, bound);
+    RouteManager::setRouteProgrammer(std::unique_ptr<RouteProgrammer>(routeProgrammer));
+    RouteManager::initialize(
+        checkInterval, probeInterval, probeRetries, "", RouteSnapshot::BINARY, 0, false, 0,
+        [] (Tins::IPv6Address address, std::shared_ptr<Interface> interface) {
+            auto newPacket = makeNeighborSolicitation(*interface, address);
+            interface->send(newPacket, Metrics::NS);
+        }
+    );
+
+    // Router resolutions of alive addresses left unanswered
+    size_t resolutions = 0, unanswered = 0;
+    size_t stepCount = 0;
+    double departures = 0;
+    std::function<void ()> onStep = [&] {
+        auto now = Clock::now();
+        population.rotate(now);
+        for (departures += double(departureRate) * step / 3600; departures >= 1; departures--)
+            population.depart(now);
+
+        population.visitBucket(stepCount++, [&] (uint32_t id) {
+            auto answered = transmitter->naToRouter;
+            auto packet = makeNeighborSolicitation(router, makeHostAddress(id));
+            Sniffer::process(transmitter->upstream, packet, PacketTrace::now());
+            transmitter->deliverAnswers();
+
+            resolutions++;
+            if (transmitter->naToRouter == answered) unanswered++;
+        });
+
+        Clock::schedule(step, onStep);
+    };
+    Clock::schedule(0, onStep);
+
+    std::function<void ()> onReport = [&] {
+        fmt::print(
+            "{:>7}s  routes {:>9}  probes {:>10}  expired {:>9}  late {:>6}  alive deleted {}\n",
+            Clock::now() - SIMULATION_START, RouteManager::getRouteCount(), Metrics::probesSent.get(),
+            Metrics::routesExpired.get(), routeProgrammer->late, routeProgrammer->deletedAlive
+        );
+        Clock::schedule(reportInterval, onReport);
+    };
+    if (reportInterval != 0) Clock::schedule(reportInterval, onReport);
+    auto setupTime = std::chrono::steady_clock::now() - setupStart;
+
+    // Packets sent by timers are answered once the timer is done
+    auto end = SIMULATION_START + (time_t)duration;
+    auto runStart = std::chrono::steady_clock::now();
+    while (Clock::runNext(end)) transmitter->deliverAnswers();
+    auto runTime = std::chrono::steady_clock::now() - runStart;
+
+    // Routes of addresses gone for longer than the expiry bound are stale
+    size_t stale = 0, expiring = 0;
+    size_t cursor = 0;
+    do {
+        cursor = RouteManager::visitRoutes(cursor, 4096, [&] (const RouteManager::RouteInfo &route) {
+            auto id = population.find(route.address);
+            if (!id || population.isAlive(*id)) return;
+            (Clock::now() - population.getDiedAt(*id) > bound ? stale : expiring)++;
+        });
+    } while (cursor != 0);
+
+    const auto &delay = routeProgrammer->expiryDelay;
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    auto cpuSeconds = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+    auto runSeconds = std::chrono::duration<double>(runTime).count();
+
+    fmt::print("\nsimulated        {} s in {:.3f} s ({:.0f}x real time), setup {:.3f} s, CPU {:.3f} s\n",
+        duration, runSeconds, duration / std::max(runSeconds, 1e-9), std::chrono::duration<double>(setupTime).count(), cpuSeconds);
+    fmt::print("population       {} hosts, {} addresses created, {} rotated, {} hosts departed\n",
+        population.getHostCount(), population.getAddressCount(), population.rotated, population.departed);
+    fmt::print("memory           {} KiB RSS, {} KiB peak\n", getRssKilobytes(), usage.ru_maxrss);
+    fmt::print("routes           {} in table, {} added, {} expired\n",
+        RouteManager::getRouteCount(), Metrics::routesAdded.get(), Metrics::routesExpired.get());
+    fmt::print("router           {} resolutions, {} unanswered, {} NS replied, {} NS forwarded\n",
+        resolutions, unanswered, Metrics::nsReplied.get(), Metrics::nsForwarded.get());
+    fmt::print("probe traffic    {} probes, {} NS to hosts ({:.2f}/s), {} NA to router\n",
+        Metrics::probesSent.get(), transmitter->nsToHosts, double(transmitter->nsToHosts) / std::max<size_t>(duration, 1), transmitter->naToRouter);
+    fmt::print("requests         {} added, {} answered, {} expired\n",
+        Metrics::requestsAdded.get(), Metrics::requestsAnswered.get(), Metrics::requestsExpired.get());
+    fmt::print("\nexpiry, bound {} s\n", bound);
+    fmt::print("deletion delay   p50 {} s, p99 {} s, p99.9 {} s\n", delay.percentile(0.5), delay.percentile(0.99), delay.percentile(0.999));
+    fmt::print("late deletions   {}\n", routeProgrammer->late);
+    fmt::print("alive deleted    {}\n", routeProgrammer->deletedAlive);
+    fmt::print("stale routes     {} ({} dead within the bound)\n", stale, expiring);
+
+    // The routes are deleted on exit, that isn't expiry
+    routeProgrammer->finished = true;
+    Logger::flush();
+
+    return routeProgrammer->deletedAlive == 0 && stale == 0 && routeProgrammer->late == 0 && unanswered == 0 ? 0 : 2;
+}
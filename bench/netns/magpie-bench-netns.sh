@@ -0,0 +1,134 @@
+#!/bin/bash
+# End-to-end benchmark of Magpie relaying between network namespaces:
+#
+#   [mp-router] r0 <--veth--> wan [mp-relay: magpie] lan <--veth--> h0 [mp-hosts]
+#
+# The router and the hosts share one /64 and can only reach each other through the NDP proxy.
+# Reports how long the router waits to resolve a host, and how long until a whole population
+# of hosts is reachable. Without root, it runs in a user namespace (unprivileged user
+# namespaces must be enabled).
+
+set -euo pipefail
+
+MAGPIE=./src/magpie
+HOSTS=1000
+SAMPLES=50
+PARALLEL=64
+MAGPIE_ARGS=()
+
+usage() {
+    echo "Usage: $0 [-b magpie-binary] [-n hosts] [-s latency-samples] [-p parallel-pings] [-- magpie-args...]"
+    exit 1
+}
+
+while getopts "b:n:s:p:h" option; do
+    case $option in
+        b) MAGPIE=$OPTARG ;;
+        n) HOSTS=$OPTARG ;;
+        s) SAMPLES=$OPTARG ;;
+        p) PARALLEL=$OPTARG ;;
+        *) usage ;;
+    esac
+done
+shift $((OPTIND - 1))
+MAGPIE_ARGS=("$@")
+
+MAGPIE=$(realpath "$MAGPIE")
+for command in ip ping xargs; do
+    command -v $command > /dev/null || { echo "$command is required"; exit 1; }
+done
+[ -x "$MAGPIE" ] || { echo "magpie binary not found: $MAGPIE"; exit 1; }
+(( SAMPLES <= HOSTS )) || SAMPLES=$HOSTS
+
+# Get our own network and mount namespaces (and root in them) when not root
+if [ "$(id -u)" != 0 ] && [ -z "${MAGPIE_BENCH_UNSHARED:-}" ]; then
+    exec env MAGPIE_BENCH_UNSHARED=1 unshare --user --map-root-user --net --mount "$0" -b "$MAGPIE" -n "$HOSTS" -s "$SAMPLES" -p "$PARALLEL" -- "${MAGPIE_ARGS[@]}"
+fi
+if [ -n "${MAGPIE_BENCH_UNSHARED:-}" ]; then
+    # "ip netns" needs a writable /run/netns
+    mount -t tmpfs tmpfs /run
+fi
+
+PREFIX=2001:db8:0:1
+ROUTER_ADDRESS=$PREFIX::1
+WORK_DIR=$(mktemp -d)
+
+host_address() {
+    printf "$PREFIX::1:%x" "$1"
+}
+
+now_ms() {
+    echo $(( $(date +%s%N) / 1000000 ))
+}
+
+cleanup() {
+    set +e
+    [ -n "${MAGPIE_PID:-}" ] && kill "$MAGPIE_PID" 2> /dev/null && wait "$MAGPIE_PID" 2> /dev/null
+    for ns in mp-router mp-relay mp-hosts; do ip netns del $ns 2> /dev/null || true; done
+    rm -rf "$WORK_DIR"
+}
+trap cleanup EXIT
+
+# Topology
+for ns in mp-router mp-relay mp-hosts; do
+    ip netns add $ns
+    ip -n $ns link set lo up
+    ip netns exec $ns sysctl -qw net.ipv6.conf.all.accept_dad=0 net.ipv6.conf.default.accept_dad=0
+done
+ip netns exec mp-relay sysctl -qw net.ipv6.conf.all.forwarding=1
+
+ip link add r0 netns mp-router type veth peer name wan netns mp-relay
+ip link add h0 netns mp-hosts type veth peer name lan netns mp-relay
+ip -n mp-router link set r0 up
+ip -n mp-relay link set wan up
+ip -n mp-relay link set lan up
+ip -n mp-hosts link set h0 up
+
+ip -n mp-router addr add $ROUTER_ADDRESS/64 dev r0 nodad
+for (( i = 0; i < HOSTS; i++ )); do
+    echo "addr add $(host_address $i)/64 dev h0 nodad"
+done | ip -n mp-hosts -batch -
+
+# Wait for link-local addresses
+sleep 1
+
+ip netns exec mp-relay "$MAGPIE" -i wan,lan -l warning "${MAGPIE_ARGS[@]}" > "$WORK_DIR/magpie.log" 2>&1 &
+MAGPIE_PID=$!
+sleep 1
+kill -0 "$MAGPIE_PID" 2> /dev/null || { echo "magpie failed to start:"; cat "$WORK_DIR/magpie.log"; exit 1; }
+
+# Print min, median, p90 and max of the numbers in a file
+summarize() {
+    sort -n "$1" | awk '{ v[NR] = $1 } END {
+        if (NR == 0) { print "no samples"; exit }
+        printf "min %.2f, median %.2f, p90 %.2f, max %.2f ms (%d samples)\n", v[1], v[int((NR + 1) / 2)], v[int((NR * 9 + 9) / 10)], v[NR], NR
+    }'
+}
+
+# The first echo request waits for the neighbor resolution, so its RTT is the resolution latency
+ping_rtt() {
+    ip netns exec mp-router ping -c 1 -W 3 "$1" | sed -n 's/.*time=\([0-9.]*\) ms.*/\1/p'
+}
+
+echo "== resolution latency, $SAMPLES hosts one by one"
+for (( i = 0; i < SAMPLES; i++ )); do ping_rtt "$(host_address $i)"; done > "$WORK_DIR/cold"
+echo "cold (unknown to magpie): $(summarize "$WORK_DIR/cold")"
+# Let the router forget the neighbors, keep the routes in magpie
+ip -n mp-router neigh flush dev r0
+for (( i = 0; i < SAMPLES; i++ )); do ping_rtt "$(host_address $i)"; done > "$WORK_DIR/warm"
+echo "warm (route known):       $(summarize "$WORK_DIR/warm")"
+
+REMAINING=$(( HOSTS - SAMPLES ))
+if (( REMAINING > 0 )); then
+    echo "== convergence, $REMAINING hosts at once, $PARALLEL in parallel"
+    START=$(now_ms)
+    for (( i = SAMPLES; i < HOSTS; i++ )); do host_address $i; echo; done \
+        | xargs -P "$PARALLEL" -I {} ip netns exec mp-router ping -c 1 -W 5 -q {} 2> /dev/null \
+        | grep -c " 1 received" > "$WORK_DIR/reachable" || true
+    END=$(now_ms)
+    echo "reachable: $(cat "$WORK_DIR/reachable") / $REMAINING in $(( END - START )) ms"
+fi
+
+echo "== relay state"
+echo "host routes: $(ip -n mp-relay -6 route show dev lan | grep -vc '^fe80\|/64')"
+kill -0 "$MAGPIE_PID" 2> /dev/null || { echo "magpie exited:"; cat "$WORK_DIR/magpie.log"; exit 1; }
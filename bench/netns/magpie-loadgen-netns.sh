@@ -0,0 +1,82 @@
+#!/bin/bash
+# Runs magpie-loadgen against a real Magpie binary in network namespaces:
+#
+#   [mp-gen: magpie-loadgen] r0 <--veth--> wan  [mp-relay: magpie]
+#                            h0 <--veth--> lan0
+#                            h1 <--veth--> lan1
+#
+# Arguments after "--" are passed to magpie-loadgen, e.g. "-- -S churn -n 20000". Without root,
+# it runs in a user namespace (unprivileged user namespaces must be enabled).
+
+set -euo pipefail
+
+MAGPIE=./src/magpie
+LOADGEN=./bench/magpie-loadgen
+MAGPIE_ARGS=""
+
+usage() {
+    echo "Usage: $0 [-b magpie-binary] [-g magpie-loadgen-binary] [-a magpie-args] [-- loadgen-args...]"
+    exit 1
+}
+
+while getopts "b:g:a:h" option; do
+    case $option in
+        b) MAGPIE=$OPTARG ;;
+        g) LOADGEN=$OPTARG ;;
+        a) MAGPIE_ARGS=$OPTARG ;;
+        *) usage ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+MAGPIE=$(realpath "$MAGPIE")
+LOADGEN=$(realpath "$LOADGEN")
+command -v ip > /dev/null || { echo "ip is required"; exit 1; }
+[ -x "$MAGPIE" ] || { echo "magpie binary not found: $MAGPIE"; exit 1; }
+[ -x "$LOADGEN" ] || { echo "magpie-loadgen binary not found: $LOADGEN"; exit 1; }
+
+# Get our own network and mount namespaces (and root in them) when not root
+if [ "$(id -u)" != 0 ] && [ -z "${MAGPIE_BENCH_UNSHARED:-}" ]; then
+    exec env MAGPIE_BENCH_UNSHARED=1 unshare --user --map-root-user --net --mount "$0" -b "$MAGPIE" -g "$LOADGEN" -a "$MAGPIE_ARGS" -- "$@"
+fi
+if [ -n "${MAGPIE_BENCH_UNSHARED:-}" ]; then
+    # "ip netns" needs a writable /run/netns
+    mount -t tmpfs tmpfs /run
+fi
+
+WORK_DIR=$(mktemp -d)
+CONTROL_SOCKET=$WORK_DIR/control.sock
+
+cleanup() {
+    set +e
+    [ -n "${MAGPIE_PID:-}" ] && kill "$MAGPIE_PID" 2> /dev/null && wait "$MAGPIE_PID" 2> /dev/null
+    for ns in mp-gen mp-relay; do ip netns del $ns 2> /dev/null || true; done
+    rm -rf "$WORK_DIR"
+}
+trap cleanup EXIT
+
+for ns in mp-gen mp-relay; do
+    ip netns add $ns
+    ip -n $ns link set lo up
+    ip netns exec $ns sysctl -qw net.ipv6.conf.all.accept_dad=0 net.ipv6.conf.default.accept_dad=0
+done
+ip netns exec mp-relay sysctl -qw net.ipv6.conf.all.forwarding=1
+
+ip link add r0 netns mp-gen type veth peer name wan netns mp-relay
+ip link add h0 netns mp-gen type veth peer name lan0 netns mp-relay
+ip link add h1 netns mp-gen type veth peer name lan1 netns mp-relay
+for device in r0 h0 h1; do ip -n mp-gen link set $device up; done
+for device in wan lan0 lan1; do ip -n mp-relay link set $device up; done
+
+# Wait for link-local addresses
+sleep 1
+
+# shellcheck disable=SC2086
+ip netns exec mp-relay "$MAGPIE" -i wan,lan0,lan1 -l warning -c "$CONTROL_SOCKET" $MAGPIE_ARGS > "$WORK_DIR/magpie.log" 2>&1 &
+MAGPIE_PID=$!
+sleep 1
+kill -0 "$MAGPIE_PID" 2> /dev/null || { echo "magpie failed to start:"; cat "$WORK_DIR/magpie.log"; exit 1; }
+
+ip netns exec mp-gen "$LOADGEN" -u r0 -d h0,h1 -c "$CONTROL_SOCKET" "$@"
+
+kill -0 "$MAGPIE_PID" 2> /dev/null || { echo "magpie exited:"; cat "$WORK_DIR/magpie.log"; exit 1; }
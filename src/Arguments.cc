@@ -1,12 +1,61 @@
 #include "Arguments.h"
 
 #include <regex>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
 
 #include "ArgumentParser/ArgumentParser.h"
+#include "Utils.h"
+
+static std::string findConfigFile(int argc, char *argv[]) {
+    std::string configFile;
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        if (argument == "--") break;
+        if (argument == "--config" && i + 1 < argc) configFile = argv[++i];
+        else if (argument.rfind("--config=", 0) == 0) configFile = argument.substr(9);
+    }
+    return configFile;
+}
+
+// Whitespace separated arguments, from "#" to the end of a line is ignored
+static std::vector<std::string> readConfigFile(const std::string &path) {
+    std::ifstream file(path);
+    if (!file) throw std::invalid_argument("Failed to read config file: " + path);
+
+    std::vector<std::string> words;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream stream(line.substr(0, line.find('#')));
+        for (std::string word; stream >> word; ) words.push_back(word);
+    }
+    return words;
+}
+
+Arguments parseArguments(int argc, char *argv[], bool exitOnError) {
+    // The arguments in the config file go before the command line, which takes precedence
+    std::vector<std::string> words = {argv[0]};
+    if (auto configFile = findConfigFile(argc, argv); !configFile.empty()) {
+        try {
+            auto configWords = readConfigFile(configFile);
+            words.insert(words.end(), configWords.begin(), configWords.end());
+        } catch (const std::invalid_argument &e) {
+            if (!exitOnError) throw;
+            std::clog << e.what() << std::endl;
+            exit(2);
+        }
+    }
+    words.insert(words.end(), argv + 1, argv + argc);
+
+    std::vector<char *> wordPointers;
+    for (auto &word : words) wordPointers.push_back(word.data());
 
-Arguments parseArguments(int argc, char *argv[]) {
     Arguments arguments;
-    ArgumentParser(argc, argv)
+    ArgumentParser parser(wordPointers.size(), wordPointers.data());
+    if (!exitOnError) parser.throwOnError();
+    parser
         .setProgramDescription(
             "Magpie " BUILD_VERSION " (https://github.com/Menci/magpie)\n"
             "               .-'-._  \n"
@@ -32,6 +81,26 @@ Arguments parseArguments(int argc, char *argv[]) {
             },
             false
         )
+        .addOption(
+            "prefixes", "",
+            "list",
+            "List of prefixes to relay (separated with ','), NDP for other targets is dropped in the kernel, as for link-local targets always. All if empty.",
+            [&] (const std::string &s) -> std::optional<std::string> {
+                // Replacing the list of the config file, as given later
+                std::vector<IPv6Prefix> prefixes;
+                std::regex re(",");
+                if (!s.empty()) {
+                    for (auto it = std::sregex_token_iterator(s.begin(), s.end(), re, -1); it != std::sregex_token_iterator(); it++) {
+                        auto prefix = parsePrefix(*it);
+                        if (!prefix) return "invalid prefix: " + it->str();
+                        prefixes.push_back(*prefix);
+                    }
+                }
+                arguments.prefixes = std::move(prefixes);
+                return std::nullopt;
+            },
+            true, ""
+        )
         .addOption(
             "log-level", "l",
             "level",
@@ -49,6 +118,26 @@ Arguments parseArguments(int argc, char *argv[]) {
             true,
             "info"
         )
+        .addOption(
+            "log-target", "",
+            "target",
+            "Where to write logs. Possible values are: stderr, syslog, file:<path>.",
+            [&] (const std::string &s) -> std::optional<std::string> {
+                if (s == "stderr") {
+                    arguments.logTarget = Logger::STDERR;
+                } else if (s == "syslog") {
+                    arguments.logTarget = Logger::SYSLOG;
+                } else if (s.rfind("file:", 0) == 0 && s.length() > 5) {
+                    arguments.logTarget = Logger::LOGFILE;
+                    arguments.logFile = s.substr(5);
+                } else {
+                    return "unknown log target: " + s;
+                }
+                return std::nullopt;
+            },
+            true,
+            "stderr"
+        )
         .addOption(
             "alarm-interval", "a",
             "seconds",
@@ -70,6 +159,27 @@ Arguments parseArguments(int argc, char *argv[]) {
             ArgumentParser::integerParser(arguments.routeProbeRetries),
             true, "5"
         )
+        .addOption(
+            "probe-interval-min", "",
+            "seconds",
+            "Probe the routes that moved, or needed retries, as often as this. 0 to keep the probe interval.",
+            ArgumentParser::integerParser(arguments.routeProbeIntervalMin),
+            true, "0"
+        )
+        .addOption(
+            "probe-interval-max", "",
+            "seconds",
+            "Back off from the routes answering every probe to this interval. 0 to keep the probe interval.",
+            ArgumentParser::integerParser(arguments.routeProbeIntervalMax),
+            true, "0"
+        )
+        .addOption(
+            "mac-verify-interval", "",
+            "seconds",
+            "Group routes by the MAC address in NA, so one address answering a probe keeps the others of the host. Each address is still probed itself after this long. 0 to probe every address on its own.",
+            ArgumentParser::integerParser(arguments.macVerifyInterval),
+            true, "0"
+        )
         .addOption(
             "routes-save-file", "f",
             "path",
@@ -77,7 +187,199 @@ Arguments parseArguments(int argc, char *argv[]) {
             ArgumentParser::stringParser(arguments.routesSaveFile),
             true, ""
         )
+        .addOption(
+            "routes-save-format", "F",
+            "format",
+            "The format to save routes in. Possible values are: binary, json. Both are accepted on loading.",
+            [&] (std::string s) -> std::optional<std::string> {
+                for (auto &ch : s) ch = std::tolower(ch);
+                if (s == "binary") arguments.routesSaveFormat = RouteSnapshot::BINARY;
+                else if (s == "json") arguments.routesSaveFormat = RouteSnapshot::JSON;
+                else return "unknown routes save format: " + s;
+                return std::nullopt;
+            },
+            true,
+            "binary"
+        )
+        .addOption(
+            "routes-save-interval", "s",
+            "seconds",
+            "The interval to save routes to file in background, 0 to save only on exit.",
+            ArgumentParser::integerParser(arguments.routesSaveInterval),
+            true, "0"
+        )
+        .addOption(
+            "warm-start", "w",
+            "",
+            "Install saved routes immediately on start as provisional, and delete them if not confirmed by probes.",
+            ArgumentParser::boolParser(arguments.warmStart),
+            true
+        )
+        .addOption(
+            "warm-start-probe-rate", "",
+            "count",
+            "The max number of probes per second to verify provisional routes on warm start.",
+            ArgumentParser::integerParser(arguments.warmStartProbeRate),
+            true, "100"
+        )
+        .addOption(
+            "metrics-listen", "m",
+            "address",
+            "Serve Prometheus metrics over HTTP on \"host:port\" or \"unix:/path\", disabled if empty.",
+            ArgumentParser::stringParser(arguments.metricsListen),
+            true, ""
+        )
+        .addOption(
+            "slow-packet-threshold", "",
+            "ms",
+            "Log (sampled) packets taking longer than this from capture to response, 0 to disable.",
+            ArgumentParser::integerParser(arguments.slowPacketThreshold),
+            true, "50"
+        )
+        .addOption(
+            "control-socket", "c",
+            "path",
+            "Accept route table queries and commands on this Unix socket, disabled if empty.",
+            ArgumentParser::stringParser(arguments.controlSocket),
+            true, ""
+        )
+        .addOption(
+            "location-history", "",
+            "count",
+            "Remember where this many addresses and MAC addresses were last seen, and send NS for unknown targets to that interface first. 0 to always send to all interfaces.",
+            ArgumentParser::integerParser(arguments.locationHistory),
+            true, "0"
+        )
+        .addOption(
+            "targeted-ns-timeout", "",
+            "milliseconds",
+            "The time to wait for the target of a targeted NS before sending it to all interfaces.",
+            ArgumentParser::integerParser(arguments.targetedNsTimeout),
+            true, "300"
+        )
+        .addOption(
+            "trunk", "",
+            "name",
+            "Capture the interfaces that are VLANs of this device once on the device, and send to them as tagged frames on it.",
+            ArgumentParser::stringParser(arguments.trunk),
+            true, ""
+        )
+        .addOption(
+            "kernel-proxy", "",
+            "",
+            "Add a proxy neighbor entry of each route on the other interfaces, and enable proxy_ndp there, so NS for known routes are answered by the kernel.",
+            ArgumentParser::boolParser(arguments.kernelProxy),
+            true
+        )
+        .addOption(
+            "hotplug", "",
+            "",
+            "Follow the interfaces being added, removed, brought up and down, instead of exiting if one is missing on start.",
+            ArgumentParser::boolParser(arguments.hotplug),
+            true
+        )
+        .addOption(
+            "capture-cpus", "",
+            "list",
+            "Pin the capture threads to these CPUs, e.g. \"2,4-5\". Not pinned if empty.",
+            [&] (const std::string &s) -> std::optional<std::string> {
+                if (s.empty()) return std::nullopt;
+                auto cpus = parseCpuList(s);
+                if (!cpus) return "invalid CPU list: " + s;
+                arguments.captureCpus = *cpus;
+                return std::nullopt;
+            },
+            true, ""
+        )
+        .addOption(
+            "processing-cpus", "",
+            "list",
+            "Pin the packet processing thread to these CPUs. Not pinned if empty.",
+            [&] (const std::string &s) -> std::optional<std::string> {
+                if (s.empty()) return std::nullopt;
+                auto cpus = parseCpuList(s);
+                if (!cpus) return "invalid CPU list: " + s;
+                arguments.processingCpus = *cpus;
+                return std::nullopt;
+            },
+            true, ""
+        )
+        .addOption(
+            "realtime-priority", "",
+            "priority",
+            "Run the capture and packet processing threads with SCHED_FIFO at this priority (1-99), 0 to keep the normal policy.",
+            ArgumentParser::integerParser<int>(arguments.realtimePriority, [] (const int &priority) -> std::optional<std::string> {
+                if (priority < 0 || priority > 99) return "realtime priority must be between 0 and 99";
+                return std::nullopt;
+            }),
+            true, "0"
+        )
+        .addOption(
+            "busy-poll", "",
+            "microseconds",
+            "Busy poll the capture sockets for up to this long (SO_BUSY_POLL and SO_PREFER_BUSY_POLL), 0 to disable.",
+            ArgumentParser::integerParser<int>(arguments.busyPoll, [] (const int &microseconds) -> std::optional<std::string> {
+                if (microseconds < 0) return "busy poll time must not be negative";
+                return std::nullopt;
+            }),
+            true, "0"
+        )
+        .addOption(
+            "lock-memory", "",
+            "",
+            "Lock the memory of the process (mlockall), so the packet path never waits for a page fault.",
+            ArgumentParser::boolParser(arguments.lockMemory),
+            true
+        )
+        .addOption(
+            "config", "",
+            "path",
+            "Read more arguments from this file, before the command line ones. It's read again on SIGHUP or the \"reload\" control command.",
+            ArgumentParser::stringParser(arguments.configFile),
+            true, ""
+        )
+        .addOption(
+            "handoff", "",
+            "path",
+            "Take the routes over from the process listening on this Unix socket instead of starting anew, then listen on it to hand them over to the next one. Disabled if empty.",
+            ArgumentParser::stringParser(arguments.handoffSocket),
+            true, ""
+        )
+        .addOption(
+            "replication-listen", "",
+            "address",
+            "Receive routes from, or ask for them, the replication peer on \"host:port\" (UDP) or \"unix:/path\". Disabled if empty.",
+            ArgumentParser::stringParser(arguments.replicationListen),
+            true, ""
+        )
+        .addOption(
+            "replication-peer", "",
+            "address",
+            "Send the route changes to the standby instance on this address, of the same kind as the listen address.",
+            ArgumentParser::stringParser(arguments.replicationPeer),
+            true, ""
+        )
+        .addOption(
+            "standby", "",
+            "",
+            "Start as the standby instance, not capturing but keeping the routes replicated from the peer until promoted.",
+            ArgumentParser::boolParser(arguments.standby),
+            true
+        )
         .parse();
+
+    // Checked here, so a bad configuration exits before any route is installed
+    const char *error = nullptr;
+    if (arguments.replicationListen.empty() != arguments.replicationPeer.empty())
+        error = "both --replication-listen and --replication-peer are needed for replication";
+    else if (arguments.standby && arguments.replicationPeer.empty())
+        error = "--standby needs replication from a peer";
+    if (error) {
+        if (!exitOnError) throw std::invalid_argument(error);
+        std::clog << error << std::endl;
+        exit(2);
+    }
+
     return arguments;
 
 }
@@ -4,14 +4,45 @@
 #include <string>
 
 #include "Logger.h"
+#include "RouteSnapshot.h"
+#include "Utils.h"
 
 struct Arguments {
     std::vector<std::string> interfaces;
+    std::vector<IPv6Prefix> prefixes;
     Logger::LogLevel logLevel;
+    Logger::Target logTarget;
+    std::string logFile;
     size_t alarmInterval;
     size_t routeProbeInterval;
     size_t routeProbeRetries;
+    size_t routeProbeIntervalMin;
+    size_t routeProbeIntervalMax;
+    size_t macVerifyInterval;
     std::string routesSaveFile;
+    RouteSnapshot::Format routesSaveFormat;
+    size_t routesSaveInterval;
+    bool warmStart;
+    size_t warmStartProbeRate;
+    std::string metricsListen;
+    size_t slowPacketThreshold;
+    std::string controlSocket;
+    size_t locationHistory;
+    size_t targetedNsTimeout;
+    std::string trunk;
+    bool hotplug;
+    std::string configFile;
+    std::string handoffSocket;
+    std::string replicationListen;
+    std::string replicationPeer;
+    bool standby;
+    bool kernelProxy;
+    std::vector<int> captureCpus;
+    std::vector<int> processingCpus;
+    int realtimePriority;
+    int busyPoll;
+    bool lockMemory;
 };
 
-Arguments parseArguments(int argc, char *argv[]);
+// Exits on invalid arguments, or throws std::invalid_argument if not exitOnError
+Arguments parseArguments(int argc, char *argv[], bool exitOnError = true);
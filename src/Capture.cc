@@ -0,0 +1,78 @@
+#include "Capture.h"
+
+#include <thread>
+#include <condition_variable>
+
+#include "Logger.h"
+#include "Interface.h"
+#include "Scheduling.h"
+
+void TinsCapture::start(std::shared_ptr<Interface> interface, const std::string &filter, Handler handler) {
+    std::mutex startMutex;
+    std::condition_variable cv;
+    bool started = false;
+
+    auto stopped = std::make_shared<std::atomic<bool>>(false);
+    {
+        std::lock_guard lock(mutex);
+        this->stopped = stopped;
+    }
+
+    std::thread([&, this, interface, filter, handler, stopped] {
+        auto notifyStarted = [&] {
+            std::lock_guard lock(startMutex);
+            started = true;
+            cv.notify_one();
+        };
+
+        // The interface could be gone again when added at runtime
+        std::unique_ptr<Tins::Sniffer> sniffer;
+        try {
+            sniffer = std::make_unique<Tins::Sniffer>(interface->name);
+            if (!sniffer->set_filter(filter)) {
+                LOGGER_ERROR("failed to set pcap filter on {}", interface->name);
+                sniffer.reset();
+            }
+        } catch (const std::exception &e) {
+            LOGGER_ERROR("failed to capture on {}: {}", interface->name, e.what());
+        }
+        if (!sniffer) {
+            notifyStarted();
+            return;
+        }
+
+        {
+            std::lock_guard lock(mutex);
+            if (!*stopped) this->sniffer = sniffer.get();
+        }
+        notifyStarted();
+        Scheduling::applyToCaptureThread(sniffer->get_fd());
+
+        // Enter loop, keeping the capture timestamp of each packet. It ends when stopped, or on
+        // an error when the interface is removed
+        for (auto &packet : *sniffer) {
+            if (*stopped) break;
+
+            const auto &timestamp = packet.timestamp();
+            handler(
+                std::unique_ptr<Tins::PDU>(packet.release_pdu()),
+                timestamp.seconds() * 1000000 + timestamp.microseconds()
+            );
+        }
+
+        std::lock_guard lock(mutex);
+        if (this->sniffer == sniffer.get()) this->sniffer = nullptr;
+    }).detach();
+
+    // Wait for started
+    {
+        std::unique_lock lock(startMutex);
+        cv.wait(lock, [&] { return started; });
+    }
+}
+
+void TinsCapture::stop() {
+    std::lock_guard lock(mutex);
+    if (stopped) *stopped = true;
+    if (sniffer) sniffer->stop_sniff();
+}
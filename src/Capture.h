@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <functional>
+#include <tins/tins.h>
+
+struct Interface;
+
+// Captures packets from an interface. The default captures with libpcap, other implementations
+// are used to run the processing logic without real interfaces.
+class Capture {
+public:
+    // Called on the capture thread, with the capture timestamp in microseconds since epoch
+    using Handler = std::function<void (std::unique_ptr<Tins::PDU> pdu, int64_t captureTime)>;
+
+    virtual ~Capture() = default;
+
+    // Start capturing packets matching the pcap filter on a new thread, return once started
+    virtual void start(std::shared_ptr<Interface> interface, const std::string &filter, Handler handler) = 0;
+    // Stop capturing, the thread exits after its current packet. It may be started again
+    virtual void stop() {}
+    // Stop capturing for the interface only. A capture shared with other interfaces keeps running
+    // for them
+    virtual void stop(const Interface &) {
+        stop();
+    }
+};
+
+class TinsCapture : public Capture {
+    std::mutex mutex;
+    Tins::Sniffer *sniffer = nullptr;
+    // Of the current capture thread
+    std::shared_ptr<std::atomic<bool>> stopped;
+
+public:
+    void start(std::shared_ptr<Interface> interface, const std::string &filter, Handler handler) override;
+    void stop() override;
+};
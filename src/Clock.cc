@@ -0,0 +1,47 @@
+#include "Clock.h"
+
+#include <algorithm>
+
+std::chrono::milliseconds Clock::nowMilliseconds() {
+    if (virtualMode) return virtualNow;
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch());
+}
+
+void Clock::setVirtual(time_t start) {
+    virtualMode = true;
+    virtualNow = std::chrono::seconds(start);
+}
+
+void Clock::schedule(std::chrono::milliseconds delay, std::function<void ()> task) {
+    timers.emplace(nowMilliseconds() + delay, std::move(task));
+}
+
+std::optional<std::chrono::steady_clock::time_point> Clock::getNextDue() {
+    if (timers.empty()) return std::nullopt;
+    return std::chrono::steady_clock::time_point(timers.begin()->first);
+}
+
+void Clock::runDue() {
+    // Timers scheduled by the tasks with no delay wait for the next call
+    auto current = nowMilliseconds();
+    for (size_t count = timers.size(); count > 0 && !timers.empty() && timers.begin()->first <= current; count--) {
+        auto task = std::move(timers.begin()->second);
+        timers.erase(timers.begin());
+        task();
+    }
+}
+
+bool Clock::runNext(time_t until) {
+    std::chrono::milliseconds untilMilliseconds = std::chrono::seconds(until);
+    if (timers.empty() || timers.begin()->first > untilMilliseconds) {
+        virtualNow = std::max(virtualNow, untilMilliseconds);
+        return false;
+    }
+
+    auto it = timers.begin();
+    virtualNow = std::max(virtualNow, it->first);
+    auto task = std::move(it->second);
+    timers.erase(it);
+    task();
+    return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <ctime>
+#include <map>
+#include <chrono>
+#include <optional>
+#include <functional>
+
+// Time in seconds for route and request expiration, and timers run on the main loop. The timers
+// follow the monotonic clock, so a step of the wall clock doesn't stall or rush them. In virtual
+// mode the time only moves when the caller runs the next timer, so a simulation can go through
+// days of timers in seconds. Timers are only scheduled and run on the main loop thread.
+class Clock {
+    inline static bool virtualMode = false;
+    inline static std::chrono::milliseconds virtualNow{0};
+    inline static std::multimap<std::chrono::milliseconds, std::function<void ()>> timers;
+
+    // Of the monotonic clock, or the virtual time since epoch
+    static std::chrono::milliseconds nowMilliseconds();
+
+public:
+    static time_t now() {
+        return virtualMode ? std::chrono::duration_cast<std::chrono::seconds>(virtualNow).count() : std::time(nullptr);
+    }
+
+    // Switch to virtual time, starting at the time given
+    static void setVirtual(time_t start);
+
+    // Run the task after the delay
+    static void schedule(std::chrono::milliseconds delay, std::function<void ()> task);
+    static void schedule(time_t delaySeconds, std::function<void ()> task) {
+        schedule(std::chrono::seconds(delaySeconds), std::move(task));
+    }
+
+    // The time of the earliest timer, if any
+    static std::optional<std::chrono::steady_clock::time_point> getNextDue();
+    // Run the timers due by now
+    static void runDue();
+    // Virtual mode only. Advance to the earliest timer due no later than the time given and run
+    // it, or advance to the time if none. Returns false in the latter case
+    static bool runNext(time_t until);
+};
@@ -0,0 +1,238 @@
+#include "ControlSocket.h"
+
+#include <cstring>
+#include <sstream>
+#include <future>
+#include <thread>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <fmt/format.h>
+
+#include "Ensure/Ensure.h"
+#include "Logger.h"
+#include "Utils.h"
+#include "Interface.h"
+#include "Sniffer.h"
+#include "RouteManager.h"
+#include "RequestManager.h"
+#include "Reloader.h"
+#include "Replication.h"
+
+static bool writeAll(int fd, const std::string &data) {
+    for (size_t written = 0; written < data.length(); ) {
+        auto size = write(fd, data.data() + written, data.length() - written);
+        if (size <= 0) return false;
+        written += size;
+    }
+
+    return true;
+}
+
+static std::string formatRoute(const RouteManager::RouteInfo &route) {
+    return fmt::format(
+        "route {} dev {} last-seen {} last-probe {} retries {} interval {}{}{}\n",
+        route.address, route.interface->name, route.lastSeen, route.lastProbe, route.probeRetries, route.interval,
+        route.provisional ? " provisional" : "",
+        route.pinned ? " pinned" : ""
+    );
+}
+
+void ControlSocket::initialize(const std::string &path, int inheritedSocket) {
+    if (inheritedSocket >= 0) {
+        LOGGER_INFO("serving the control socket {} taken over from the previous process", path);
+        listeningSocket = inheritedSocket;
+        std::thread(serveLoop, inheritedSocket).detach();
+        return;
+    }
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.length() >= sizeof(address.sun_path)) {
+        LOGGER_ERROR("control socket path too long: {}", path);
+        exit(1);
+    }
+    strcpy(address.sun_path, path.c_str());
+
+    int fd;
+    ENSURE_ERRNO(fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+    unlink(path.c_str());
+    ENSURE_ERRNO(bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)));
+    ENSURE_ERRNO(chmod(path.c_str(), 0600));
+    ENSURE_ERRNO(listen(fd, 16));
+    LOGGER_INFO("listening on control socket {}", path);
+
+    listeningSocket = fd;
+
+    std::thread(serveLoop, fd).detach();
+}
+
+int ControlSocket::getListeningSocket() {
+    return listeningSocket;
+}
+
+void ControlSocket::serveLoop(int listenFd) {
+    // Signal handlers touch the routing table, never run them on this thread
+    sigset_t signals;
+    sigfillset(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    while (true) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) continue;
+
+        std::thread([fd] {
+            serveClient(fd);
+            close(fd);
+        }).detach();
+    }
+}
+
+void ControlSocket::serveClient(int fd) {
+    std::string buffer;
+    char chunk[1024];
+    while (true) {
+        auto size = read(fd, chunk, sizeof(chunk));
+        if (size <= 0) return;
+        buffer.append(chunk, size);
+
+        for (size_t newline; (newline = buffer.find('\n')) != std::string::npos; ) {
+            auto line = buffer.substr(0, newline);
+            buffer.erase(0, newline + 1);
+
+            std::vector<std::string> words;
+            std::istringstream stream(line);
+            for (std::string word; stream >> word; ) words.push_back(word);
+            if (words.empty()) continue;
+
+            if (!writeAll(fd, handleRequest(words, fd))) return;
+        }
+
+        if (buffer.length() > 4096) {
+            writeAll(fd, "ERROR request too long\n");
+            return;
+        }
+    }
+}
+
+std::string ControlSocket::runOnMainLoop(std::function<std::string ()> function) {
+    auto promise = std::make_shared<std::promise<std::string>>();
+    auto future = promise->get_future();
+    Sniffer::post([promise, function] {
+        promise->set_value(function());
+    });
+    return future.get();
+}
+
+std::string ControlSocket::handleRequest(const std::vector<std::string> &words, int fd) {
+    const auto &command = words[0];
+
+    if (command == "stats") {
+        return runOnMainLoop([] {
+            return fmt::format(
+                "interfaces {}\nroutes {}\nprovisional-routes {}\npending-requests {}\nOK\n",
+                Interface::interfaces.size(),
+                RouteManager::getRouteCount(),
+                Metrics::provisionalRoutes.get(),
+                RequestManager::getRequestCount()
+            );
+        });
+    } else if (command == "dump") {
+        dumpRoutes(words, fd);
+        return "";
+    } else if (command == "reload" && words.size() == 1) {
+        return runOnMainLoop([] {
+            auto error = Reloader::reload();
+            return error ? fmt::format("ERROR {}\n", *error) : std::string("OK\n");
+        });
+    } else if ((command == "promote" || command == "demote") && words.size() == 1) {
+        return runOnMainLoop([promote = command == "promote"] {
+            if (!Replication::isEnabled()) return std::string("ERROR replication not enabled\n");
+            auto error = promote ? Replication::promote() : Replication::demote();
+            return error ? fmt::format("ERROR {}\n", *error) : std::string("OK\n");
+        });
+    }
+
+    // Others are commands on one address
+    if (words.size() < 2) return fmt::format("ERROR missing address for {}\n", command);
+    auto address = parseAddress(words[1]);
+    if (!address) return fmt::format("ERROR invalid address {}\n", words[1]);
+
+    if (command == "lookup" && words.size() == 2) {
+        return runOnMainLoop([address] {
+            auto route = RouteManager::lookupRoute(*address);
+            return route ? formatRoute(*route) + "OK\n" : std::string("ERROR no route\n");
+        });
+    } else if (command == "reprobe" && words.size() == 2) {
+        return runOnMainLoop([address] {
+            return RouteManager::reprobeRoute(*address) ? "OK\n" : "ERROR no route\n";
+        });
+    } else if (command == "pin" && (words.size() == 2 || words.size() == 3)) {
+        auto interfaceName = words.size() == 3 ? words[2] : "";
+        return runOnMainLoop([address, interfaceName] () -> std::string {
+            std::shared_ptr<Interface> interface;
+            if (!interfaceName.empty()) {
+                auto it = Interface::interfaces.find(interfaceName);
+                if (it == Interface::interfaces.end()) return "ERROR unknown interface\n";
+                interface = it->second;
+            }
+
+            return RouteManager::pinRoute(*address, interface) ? "OK\n" : "ERROR no route, specify an interface\n";
+        });
+    } else if (command == "unpin" && words.size() == 2) {
+        return runOnMainLoop([address] {
+            return RouteManager::unpinRoute(*address) ? "OK\n" : "ERROR no pinned route\n";
+        });
+    } else if (command == "delete" && words.size() == 2) {
+        return runOnMainLoop([address] {
+            return RouteManager::removeRoute(*address) ? "OK\n" : "ERROR no route\n";
+        });
+    }
+
+    return fmt::format("ERROR invalid request {}\n", command);
+}
+
+void ControlSocket::dumpRoutes(const std::vector<std::string> &words, int fd) {
+    std::string interfaceName;
+    std::optional<IPv6Prefix> prefix;
+    for (size_t i = 1; i < words.size(); i += 2) {
+        if (i + 1 >= words.size()) {
+            writeAll(fd, fmt::format("ERROR missing value for {}\n", words[i]));
+            return;
+        }
+
+        if (words[i] == "interface") {
+            interfaceName = words[i + 1];
+        } else if (words[i] == "prefix") {
+            prefix = parsePrefix(words[i + 1]);
+            if (!prefix) {
+                writeAll(fd, fmt::format("ERROR invalid prefix {}\n", words[i + 1]));
+                return;
+            }
+        } else {
+            writeAll(fd, fmt::format("ERROR unknown filter {}\n", words[i]));
+            return;
+        }
+    }
+
+    // Format a chunk of routes on each turn of the main loop, and write it out of the main loop
+    constexpr size_t CHUNK_SIZE = 1024;
+    size_t cursor = 0;
+    do {
+        auto output = runOnMainLoop([&] {
+            std::string output;
+            cursor = RouteManager::visitRoutes(cursor, CHUNK_SIZE, [&] (const RouteManager::RouteInfo &route) {
+                if (!interfaceName.empty() && route.interface->name != interfaceName) return;
+                if (prefix && !prefix->contains(route.address)) return;
+                output += formatRoute(route);
+            });
+            return output;
+        });
+
+        if (!writeAll(fd, output)) return;
+    } while (cursor != 0);
+
+    writeAll(fd, "OK\n");
+}
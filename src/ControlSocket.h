@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+
+// Unix-domain control socket with a line-based protocol. Each request is one line, the
+// response is zero or more lines ended with "OK" or "ERROR <message>". Requests are run on the
+// main loop in small steps, so a large dump never blocks packet processing for long.
+//
+//   stats
+//   reload
+//   dump [interface <name>] [prefix <address>/<length>]
+//   lookup <address>
+//   reprobe <address>
+//   pin <address> [<interface>]
+//   unpin <address>
+//   delete <address>
+//   promote
+//   demote
+class ControlSocket {
+    inline static int listeningSocket = -1;
+
+    static void serveLoop(int listenFd);
+    static void serveClient(int fd);
+    static std::string handleRequest(const std::vector<std::string> &words, int fd);
+    static void dumpRoutes(const std::vector<std::string> &words, int fd);
+
+    // Run on main loop and wait for the result
+    static std::string runOnMainLoop(std::function<std::string ()> function);
+
+public:
+    // Serve on the listening socket handed over by the previous process instead, if given
+    static void initialize(const std::string &path, int inheritedSocket = -1);
+    // -1 if not serving
+    static int getListeningSocket();
+};
@@ -0,0 +1,343 @@
+#include "Handoff.h"
+
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "Ensure/Ensure.h"
+#include "Logger.h"
+#include "Interface.h"
+#include "Sniffer.h"
+#include "ControlSocket.h"
+#include "Metrics.h"
+
+// For the other process to send or acknowledge
+constexpr time_t TIMEOUT_SECONDS = 10;
+// Way beyond any routing table, only against a corrupted preamble
+constexpr uint64_t MAX_ENTRIES = 1ull << 28;
+
+static bool sendAll(int fd, const char *data, size_t size) {
+    for (size_t sent = 0; sent < size; ) {
+        auto result = send(fd, data + sent, size - sent, MSG_NOSIGNAL);
+        if (result < 0 && errno == EINTR) continue;
+        if (result <= 0) return false;
+        sent += result;
+    }
+
+    return true;
+}
+
+static bool readAll(int fd, char *data, size_t size) {
+    for (size_t received = 0; received < size; ) {
+        auto result = read(fd, data + received, size - received);
+        if (result < 0 && errno == EINTR) continue;
+        if (result <= 0) return false;
+        received += result;
+    }
+
+    return true;
+}
+
+static sockaddr_un makeAddress(const std::string &path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.length() >= sizeof(address.sun_path)) {
+        LOGGER_ERROR("handoff socket path too long: {}", path);
+        exit(1);
+    }
+    strcpy(address.sun_path, path.c_str());
+    return address;
+}
+
+std::string Handoff::serialize(Preamble &preamble) {
+    std::vector<RouteManager::RouteInfo> routes;
+    routes.reserve(RouteManager::getRouteCount());
+    RouteManager::visitRoutes(0, SIZE_MAX, [&] (const RouteManager::RouteInfo &route) {
+        routes.push_back(route);
+    });
+
+    std::vector<RequestManager::RequestInfo> requests;
+    RequestManager::visitRequests([&] (const RequestManager::RequestInfo &request) {
+        requests.push_back(request);
+    });
+
+    // Assign interface IDs in order of first appearance
+    std::vector<const Interface *> interfaceTable;
+    std::unordered_map<const Interface *, uint32_t> interfaceIds;
+    auto getInterfaceId = [&] (const Interface *interface) {
+        auto [it, inserted] = interfaceIds.emplace(interface, interfaceTable.size());
+        if (inserted) interfaceTable.push_back(interface);
+        return it->second;
+    };
+    for (const auto &route : routes) getInterfaceId(route.interface.get());
+    for (const auto &request : requests) getInterfaceId(request.fromInterface.get());
+
+    std::memcpy(preamble.magic, MAGIC, sizeof(MAGIC));
+    preamble.version = VERSION;
+    preamble.interfaceCount = interfaceTable.size();
+    preamble.routeCount = routes.size();
+    preamble.requestCount = requests.size();
+
+    std::string buffer(
+        interfaceTable.size() * sizeof(RouteSnapshot::InterfaceName) +
+        routes.size() * sizeof(RouteEntry) +
+        requests.size() * sizeof(RequestEntry),
+        '\0'
+    );
+    auto p = buffer.data();
+
+    for (auto interface : interfaceTable) {
+        auto entry = reinterpret_cast<RouteSnapshot::InterfaceName *>(p);
+        std::strncpy(entry->name, interface->name.c_str(), sizeof(entry->name) - 1);
+        p += sizeof(RouteSnapshot::InterfaceName);
+    }
+
+    for (const auto &route : routes) {
+        auto entry = reinterpret_cast<RouteEntry *>(p);
+        std::copy(route.address.begin(), route.address.end(), entry->address);
+        entry->interfaceId = interfaceIds[route.interface.get()];
+        entry->flags = (route.provisional ? ROUTE_PROVISIONAL : 0) | (route.pinned ? ROUTE_PINNED : 0);
+        entry->lastSeen = route.lastSeen;
+        entry->lastProbe = route.lastProbe;
+        entry->probeRetries = route.probeRetries;
+        p += sizeof(RouteEntry);
+    }
+
+    for (const auto &request : requests) {
+        auto entry = reinterpret_cast<RequestEntry *>(p);
+        std::copy(request.sourceAddress.begin(), request.sourceAddress.end(), entry->sourceAddress);
+        std::copy(request.targetAddress.begin(), request.targetAddress.end(), entry->targetAddress);
+        std::copy(request.sourceMacAddress.begin(), request.sourceMacAddress.end(), entry->sourceMacAddress);
+        entry->interfaceId = interfaceIds[request.fromInterface.get()];
+        entry->requestTime = request.requestTime;
+        p += sizeof(RequestEntry);
+    }
+
+    return buffer;
+}
+
+bool Handoff::parse(const Preamble &preamble, const std::string &buffer, State &state) {
+    auto p = buffer.data();
+
+    // Resolve the interface table once
+    std::vector<std::shared_ptr<Interface>> interfaces(preamble.interfaceCount);
+    for (size_t i = 0; i < preamble.interfaceCount; i++) {
+        auto entry = reinterpret_cast<const RouteSnapshot::InterfaceName *>(p);
+        std::string name(entry->name, strnlen(entry->name, sizeof(entry->name)));
+        if (auto it = Interface::interfaces.find(name); it != Interface::interfaces.end())
+            interfaces[i] = it->second;
+        else
+            LOGGER_WARNING("dropping the routes and requests handed over on unknown interface [{}]", name);
+        p += sizeof(RouteSnapshot::InterfaceName);
+    }
+
+    auto routes = reinterpret_cast<const RouteEntry *>(p);
+    state.routes.reserve(preamble.routeCount);
+    for (size_t i = 0; i < preamble.routeCount; i++) {
+        const auto &entry = routes[i];
+        if (entry.interfaceId >= interfaces.size()) return false;
+        if (!interfaces[entry.interfaceId]) continue;
+
+        state.routes.push_back({
+            Tins::IPv6Address(entry.address),
+            interfaces[entry.interfaceId],
+            static_cast<time_t>(entry.lastProbe),
+            static_cast<time_t>(entry.lastSeen),
+            static_cast<size_t>(entry.probeRetries),
+            (entry.flags & ROUTE_PROVISIONAL) != 0,
+            (entry.flags & ROUTE_PINNED) != 0
+        });
+    }
+    p += preamble.routeCount * sizeof(RouteEntry);
+
+    auto requests = reinterpret_cast<const RequestEntry *>(p);
+    for (size_t i = 0; i < preamble.requestCount; i++) {
+        const auto &entry = requests[i];
+        if (entry.interfaceId >= interfaces.size()) return false;
+        if (!interfaces[entry.interfaceId]) continue;
+
+        state.requests.push_back({
+            Tins::HWAddress<6>(entry.sourceMacAddress),
+            Tins::IPv6Address(entry.sourceAddress),
+            Tins::IPv6Address(entry.targetAddress),
+            interfaces[entry.interfaceId],
+            static_cast<time_t>(entry.requestTime)
+        });
+    }
+
+    return true;
+}
+
+std::optional<Handoff::State> Handoff::receive(const std::string &path, const std::string &controlSocket, const std::string &metricsListen) {
+    auto address = makeAddress(path);
+
+    int fd;
+    ENSURE_ERRNO(fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        LOGGER_INFO("no running process to take over from on {}, starting anew", path);
+        close(fd);
+        return std::nullopt;
+    }
+    LOGGER_INFO("taking over from the running process on {}", path);
+
+    timeval timeout = {TIMEOUT_SECONDS, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // The running process keeps running until acknowledged, running both would fight over the routes
+    auto fail = [] (const char *reason) {
+        LOGGER_ERROR("failed to take over: {}, the running process keeps running", reason);
+        exit(1);
+    };
+
+    Preamble preamble;
+    iovec iov = {&preamble, sizeof(preamble)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * 2)];
+    msghdr message = {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    if (recvmsg(fd, &message, MSG_WAITALL | MSG_CMSG_CLOEXEC) != sizeof(preamble)) fail("no state received");
+
+    std::vector<int> sockets;
+    for (auto cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+
+        auto count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        auto begin = reinterpret_cast<const int *>(CMSG_DATA(cmsg));
+        sockets.insert(sockets.end(), begin, begin + count);
+    }
+
+    if (std::memcmp(preamble.magic, MAGIC, sizeof(MAGIC)) != 0) fail("not a handoff socket");
+    if (preamble.version != VERSION) fail("unsupported handoff version");
+    if (
+        preamble.interfaceCount > MAX_ENTRIES ||
+        preamble.routeCount > MAX_ENTRIES ||
+        preamble.requestCount > MAX_ENTRIES
+    ) fail("malformed state");
+
+    std::string buffer(
+        preamble.interfaceCount * sizeof(RouteSnapshot::InterfaceName) +
+        preamble.routeCount * sizeof(RouteEntry) +
+        preamble.requestCount * sizeof(RequestEntry),
+        '\0'
+    );
+    if (!readAll(fd, buffer.data(), buffer.size())) fail("state truncated");
+
+    State state;
+    if (!parse(preamble, buffer, state)) fail("malformed state");
+
+    // Only take the sockets served on the same address here
+    auto takeSocket = [&, next = size_t(0)] (const char *handedOverAddress, size_t length, const std::string &address) mutable {
+        std::string handedOver(handedOverAddress, strnlen(handedOverAddress, length));
+        if (handedOver.empty() || next >= sockets.size()) return -1;
+
+        auto socket = sockets[next++];
+        if (handedOver == address) return socket;
+        close(socket);
+        return -1;
+    };
+    state.controlSocket = takeSocket(preamble.controlSocket, sizeof(preamble.controlSocket), controlSocket);
+    state.metricsSocket = takeSocket(preamble.metricsListen, sizeof(preamble.metricsListen), metricsListen);
+
+    // The running process exits once acknowledged
+    char ack = 0;
+    if (!sendAll(fd, &ack, sizeof(ack))) fail("the running process is gone");
+    close(fd);
+
+    LOGGER_INFO("took over {} routes and {} pending requests", state.routes.size(), state.requests.size());
+    return state;
+}
+
+void Handoff::initialize(const std::string &path, const std::string &controlSocket, const std::string &metricsListen) {
+    Handoff::controlSocket = controlSocket;
+    Handoff::metricsListen = metricsListen;
+
+    auto address = makeAddress(path);
+
+    int fd;
+    ENSURE_ERRNO(fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+    unlink(path.c_str());
+    ENSURE_ERRNO(bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)));
+    ENSURE_ERRNO(chmod(path.c_str(), 0600));
+    ENSURE_ERRNO(listen(fd, 1));
+    LOGGER_INFO("listening for the upgraded process on {}", path);
+
+    std::thread(serveLoop, fd).detach();
+}
+
+void Handoff::serveLoop(int listenFd) {
+    // Signal handlers touch the routing table, never run them on this thread
+    sigset_t signals;
+    sigfillset(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    while (true) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) continue;
+
+        Sniffer::post([fd] { handOver(fd); });
+    }
+}
+
+void Handoff::handOver(int fd) {
+    LOGGER_INFO("new process connected, handing over");
+
+    // The new process captures already, and nothing changes here from now on
+    auto wasCapturing = Sniffer::isCapturing();
+    Sniffer::stopCaptures();
+    RouteManager::saveRoutes();
+
+    Preamble preamble = {};
+    auto buffer = serialize(preamble);
+
+    // The listening sockets go along with the preamble
+    std::vector<int> sockets;
+    if (auto socket = ControlSocket::getListeningSocket(); socket >= 0) {
+        std::strncpy(preamble.controlSocket, controlSocket.c_str(), sizeof(preamble.controlSocket) - 1);
+        sockets.push_back(socket);
+    }
+    if (auto socket = Metrics::getListeningSocket(); socket >= 0) {
+        std::strncpy(preamble.metricsListen, metricsListen.c_str(), sizeof(preamble.metricsListen) - 1);
+        sockets.push_back(socket);
+    }
+
+    iovec iov = {&preamble, sizeof(preamble)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * 2)] = {};
+    msghdr message = {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    if (!sockets.empty()) {
+        message.msg_control = control;
+        message.msg_controllen = CMSG_SPACE(sizeof(int) * sockets.size());
+        auto cmsg = CMSG_FIRSTHDR(&message);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * sockets.size());
+        std::memcpy(CMSG_DATA(cmsg), sockets.data(), sizeof(int) * sockets.size());
+    }
+
+    timeval timeout = {TIMEOUT_SECONDS, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    char ack;
+    if (
+        sendmsg(fd, &message, MSG_NOSIGNAL) == sizeof(preamble) &&
+        sendAll(fd, buffer.data(), buffer.size()) &&
+        readAll(fd, &ack, sizeof(ack))
+    ) {
+        LOGGER_INFO("handed over {} routes and {} pending requests, exiting", preamble.routeCount, preamble.requestCount);
+        RouteManager::keepRoutesOnExit();
+        exit(0);
+    }
+
+    LOGGER_ERROR("the new process didn't take over, resuming");
+    close(fd);
+    // Unless standby
+    if (wasCapturing) Sniffer::startCaptures();
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <optional>
+#include <sys/un.h>
+#include <tins/tins.h>
+
+#include "RouteManager.h"
+#include "RequestManager.h"
+#include "RouteSnapshot.h"
+
+// Hands the routes and pending requests over to an upgraded process on a Unix socket, so an upgrade
+// neither deletes the system routes nor starts cold. The new process starts capturing, connects to
+// the running one and receives:
+//
+//   Preamble                                  (with the listening sockets as SCM_RIGHTS)
+//   RouteSnapshot::InterfaceName[interfaceCount]
+//   RouteEntry[routeCount]
+//   RequestEntry[requestCount]
+//
+// The running process stops capturing and writes its routes file first, then exits keeping the
+// system routes once the new one acknowledges, or resumes if it doesn't. Interfaces are matched by
+// name, and the sockets are only used if the new process serves them on the same address.
+class Handoff {
+public:
+    static constexpr char MAGIC[8] = {'M', 'A', 'G', 'P', 'I', 'E', 'H', 'O'};
+    static constexpr uint32_t VERSION = 1;
+
+    enum RouteFlags : uint32_t {
+        ROUTE_PROVISIONAL = 1,
+        ROUTE_PINNED = 2
+    };
+
+    struct Preamble {
+        char magic[8];
+        uint32_t version;
+        uint32_t interfaceCount;
+        uint64_t routeCount;
+        uint64_t requestCount;
+        // Addresses of the control socket and metrics passed along in this order, empty if not passed
+        char controlSocket[sizeof(sockaddr_un::sun_path) + 4];
+        char metricsListen[128];
+    };
+
+    struct RouteEntry {
+        uint8_t address[Tins::IPv6Address::address_size];
+        uint32_t interfaceId;
+        uint32_t flags;
+        int64_t lastSeen;
+        int64_t lastProbe;
+        uint64_t probeRetries;
+    };
+
+    struct RequestEntry {
+        uint8_t sourceAddress[Tins::IPv6Address::address_size];
+        uint8_t targetAddress[Tins::IPv6Address::address_size];
+        uint8_t sourceMacAddress[6];
+        uint16_t reserved;
+        uint32_t interfaceId;
+        uint32_t reserved2;
+        int64_t requestTime;
+    };
+
+    static_assert(sizeof(Preamble) % 8 == 0);
+    static_assert(sizeof(RouteEntry) == 48);
+    static_assert(sizeof(RequestEntry) == 56);
+
+    struct State {
+        std::vector<RouteManager::RouteInfo> routes;
+        std::vector<RequestManager::RequestInfo> requests;
+        // Listening sockets on the same address as configured here, -1 if not handed over
+        int controlSocket = -1;
+        int metricsSocket = -1;
+    };
+
+private:
+    // Addresses served here, to tell the new process which sockets it can take over
+    inline static std::string controlSocket, metricsListen;
+
+    static void serveLoop(int listenFd);
+    // On the main loop, returns only if the new process didn't take over
+    static void handOver(int fd);
+    static std::string serialize(Preamble &preamble);
+    static bool parse(const Preamble &preamble, const std::string &buffer, State &state);
+
+public:
+    // Take over from the process listening on the path, after the captures are started. Returns
+    // nothing if there is none, exits if one is there but fails to hand over
+    static std::optional<State> receive(const std::string &path, const std::string &controlSocket, const std::string &metricsListen);
+    // Listen for the next process to hand over to
+    static void initialize(const std::string &path, const std::string &controlSocket, const std::string &metricsListen);
+};
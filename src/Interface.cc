@@ -1,40 +1,111 @@
 #include "Interface.h"
 
 #include "Logger.h"
+#include "VlanTrunk.h"
+#include "LinkMonitor.h"
 
 std::unordered_map<std::string, std::shared_ptr<Interface>> Interface::interfaces;
 
 Interface::Interface(const std::string &name) :
     name(name),
     tinsInterface(name),
-    linkLocal(getLinkLocal(tinsInterface))
+    macAddress(tinsInterface.hw_address()),
+    linkLocal(getLinkLocal(macAddress)),
+    metrics(Metrics::forInterface(name)),
+    transmitter(std::make_shared<TinsTransmitter>()),
+    capture(std::make_shared<TinsCapture>())
 {}
 
+Interface::Interface(
+    const std::string &name,
+    const Tins::HWAddress<6> &macAddress,
+    std::shared_ptr<Transmitter> transmitter,
+    std::shared_ptr<Capture> capture
+) :
+    name(name),
+    macAddress(macAddress),
+    linkLocal(getLinkLocal(macAddress)),
+    metrics(Metrics::forInterface(name)),
+    transmitter(transmitter),
+    capture(capture)
+{}
+
+void Interface::send(Tins::PDU &packet, Metrics::MessageType type) {
+    // The interface could be gone before we're notified
+    try {
+        transmitter->send(*this, packet);
+    } catch (const std::exception &e) {
+        LOGGER_WARNING("failed to send on {}: {}", name, e.what());
+        return;
+    }
+    metrics->sent[type].increment();
+}
+
+bool Interface::refresh() {
+    try {
+        tinsInterface = Tins::NetworkInterface(name);
+        macAddress = tinsInterface.hw_address();
+        linkLocal = getLinkLocal(macAddress);
+        return true;
+    } catch (const Tins::invalid_interface &) {
+        return false;
+    }
+}
+
 void Interface::initialize(const std::string &interfaceName) {
+    if (!tryInitialize(interfaceName)) {
+        LOGGER_ERROR("invalid interface {}", interfaceName);
+        exit(1);
+    }
+}
+
+std::shared_ptr<Interface> Interface::tryInitialize(const std::string &interfaceName) {
     if (interfaceName == "lo") {
-        Logger::error("refuse to relay on loopback interface!");
+        LOGGER_ERROR("refuse to relay on loopback interface!");
+        exit(1);
+    }
+
+    if (interfaces.find(interfaceName) != interfaces.end()) {
+        LOGGER_ERROR("duplicated interface {}", interfaceName);
         exit(1);
     }
 
     try {
         auto interface = std::make_shared<Interface>(interfaceName);
-
-        if (interfaces.find(interfaceName) != interfaces.end()) {
-            Logger::error("duplicated interface {}", interfaceName);
-            exit(1);
-        }
+        // Only followed with the link monitor, relayed as up otherwise
+        if (LinkMonitor::isEnabled()) interface->up = LinkMonitor::isRunning(interfaceName);
+        VlanTrunk::attach(*interface);
         interfaces[interfaceName] = interface;
+        return interface;
     } catch (const Tins::invalid_interface &) {
-        Logger::error("invalid interface {}", interfaceName);
+        return nullptr;
+    }
+}
+
+std::shared_ptr<Interface> Interface::initializeVirtual(
+    const std::string &interfaceName,
+    const Tins::HWAddress<6> &macAddress,
+    std::shared_ptr<Transmitter> transmitter,
+    std::shared_ptr<Capture> capture
+) {
+    if (interfaces.find(interfaceName) != interfaces.end()) {
+        LOGGER_ERROR("duplicated interface {}", interfaceName);
         exit(1);
     }
+
+    auto interface = std::make_shared<Interface>(interfaceName, macAddress, transmitter, capture);
+    interfaces[interfaceName] = interface;
+    return interface;
 }
 
 // Loopback interface is only used for capturing DU packets
 Interface::Interface(bool) :
     name("lo"),
     tinsInterface("lo"),
-    linkLocal("::1") // unused
+    linkLocal("::1"), // unused
+    metrics(Metrics::forInterface("lo")),
+    transmitter(std::make_shared<TinsTransmitter>()),
+    capture(std::make_shared<TinsCapture>())
 {}
 
 std::shared_ptr<Interface> Interface::getLoopback() {
@@ -6,17 +6,47 @@
 #include <tins/tins.h>
 
 #include "Utils.h"
+#include "Metrics.h"
+#include "Transmitter.h"
+#include "Capture.h"
 
 struct Interface {
     std::string name;
+    // Unset for virtual interfaces
     Tins::NetworkInterface tinsInterface;
+    Tins::HWAddress<6> macAddress;
     Tins::IPv6Address linkLocal;
+    std::shared_ptr<Metrics::InterfaceMetrics> metrics;
+    std::shared_ptr<Transmitter> transmitter;
+    // Not captured if null
+    std::shared_ptr<Capture> capture;
+    // Down or removed interfaces are skipped, and their routes suspended. Main loop only
+    bool up = true;
 
     static std::unordered_map<std::string, std::shared_ptr<Interface>> interfaces;
 
     Interface(const std::string &name);
+    // A virtual interface, not backed by a system interface
+    Interface(
+        const std::string &name,
+        const Tins::HWAddress<6> &macAddress,
+        std::shared_ptr<Transmitter> transmitter,
+        std::shared_ptr<Capture> capture = nullptr
+    );
+
+    void send(Tins::PDU &packet, Metrics::MessageType type);
+    // Look up the system interface again, after it's re-created. Returns false if it's gone
+    bool refresh();
 
     static void initialize(const std::string &interfaceName);
+    // Returns null if the interface doesn't exist
+    static std::shared_ptr<Interface> tryInitialize(const std::string &interfaceName);
+    static std::shared_ptr<Interface> initializeVirtual(
+        const std::string &interfaceName,
+        const Tins::HWAddress<6> &macAddress,
+        std::shared_ptr<Transmitter> transmitter,
+        std::shared_ptr<Capture> capture = nullptr
+    );
     static std::shared_ptr<Interface> getLoopback();
 
 private:
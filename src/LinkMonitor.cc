@@ -0,0 +1,162 @@
+#include "LinkMonitor.h"
+
+#include <cerrno>
+#include <cstring>
+#include <thread>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include "Ensure/Ensure.h"
+#include "Logger.h"
+#include "Interface.h"
+#include "Sniffer.h"
+#include "RouteManager.h"
+
+void LinkMonitor::initialize(const std::vector<std::string> &names) {
+    setNames(names);
+    enabled = true;
+
+    int fd;
+    ENSURE_ERRNO(fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE));
+    sockaddr_nl address = {};
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = RTMGRP_LINK;
+    ENSURE_ERRNO(bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)));
+
+    std::thread(monitorLoop, fd).detach();
+}
+
+void LinkMonitor::monitorLoop(int fd) {
+    alignas(nlmsghdr) char buffer[16384];
+    while (true) {
+        auto size = recv(fd, buffer, sizeof(buffer), 0);
+        if (size < 0) {
+            if (errno == EINTR) continue;
+            if (errno == ENOBUFS) {
+                // Events were lost
+                LOGGER_WARNING("netlink link events overrun, checking all interfaces");
+                Sniffer::post(resync);
+                continue;
+            }
+            LOGGER_ERROR("failed to receive netlink link events: {}", strerror(errno));
+            return;
+        }
+
+        int length = size;
+        for (auto header = reinterpret_cast<nlmsghdr *>(buffer); NLMSG_OK(header, length); header = NLMSG_NEXT(header, length)) {
+            if (header->nlmsg_type != RTM_NEWLINK && header->nlmsg_type != RTM_DELLINK) continue;
+
+            auto info = static_cast<ifinfomsg *>(NLMSG_DATA(header));
+            std::string name;
+            int attributesLength = IFLA_PAYLOAD(header);
+            for (auto attribute = IFLA_RTA(info); RTA_OK(attribute, attributesLength); attribute = RTA_NEXT(attribute, attributesLength)) {
+                if (attribute->rta_type == IFLA_IFNAME) {
+                    name = static_cast<const char *>(RTA_DATA(attribute));
+                    break;
+                }
+            }
+            {
+                std::lock_guard lock(mutex);
+                if (!names.count(name)) continue;
+            }
+
+            bool exists = header->nlmsg_type == RTM_NEWLINK;
+            bool up = exists && (info->ifi_flags & IFF_UP) && (info->ifi_flags & IFF_RUNNING);
+            Sniffer::post([name, exists, up] { onLinkChange(name, exists, up); });
+        }
+    }
+}
+
+bool LinkMonitor::isEnabled() {
+    return enabled;
+}
+
+bool LinkMonitor::isRunning(const std::string &name) {
+    int fd;
+    ENSURE_ERRNO(fd = socket(AF_INET6, SOCK_DGRAM | SOCK_CLOEXEC, 0));
+    ifreq request = {};
+    name.copy(request.ifr_name, IFNAMSIZ - 1);
+    auto result = ioctl(fd, SIOCGIFFLAGS, &request);
+    close(fd);
+    return result == 0 && (request.ifr_flags & IFF_UP) && (request.ifr_flags & IFF_RUNNING);
+}
+
+void LinkMonitor::setNames(const std::vector<std::string> &names) {
+    std::lock_guard lock(mutex);
+    LinkMonitor::names = std::unordered_set<std::string>(names.begin(), names.end());
+}
+
+void LinkMonitor::onLinkChange(const std::string &name, bool exists, bool up) {
+    // Removed from the list by a reload since
+    {
+        std::lock_guard lock(mutex);
+        if (!names.count(name)) return;
+    }
+
+    auto it = Interface::interfaces.find(name);
+    if (it == Interface::interfaces.end()) {
+        // Missing on start
+        if (!exists) return;
+
+        auto interface = Interface::tryInitialize(name);
+        if (!interface) return;
+
+        LOGGER_INFO("interface {} added", name);
+        interface->up = up;
+        Sniffer::restartCapture(interface);
+        RouteManager::addInterface(interface);
+        return;
+    }
+
+    auto interface = it->second;
+    if (!exists) {
+        if (!interface->tinsInterface.id()) return;
+
+        // The kernel deletes its routes, they're reinstalled when it's back
+        LOGGER_INFO("interface {} removed, suspending its routes", name);
+        interface->up = false;
+        interface->tinsInterface = Tins::NetworkInterface();
+        if (interface->capture) interface->capture->stop(*interface);
+        RouteManager::suspendInterface(interface);
+        return;
+    }
+
+    if (up == interface->up) {
+        // Changes such as the MAC address
+        if (up) interface->refresh();
+        return;
+    }
+
+    if (!up) {
+        LOGGER_INFO("interface {} down, suspending its routes", name);
+        interface->up = false;
+        RouteManager::suspendInterface(interface);
+        return;
+    }
+
+    // Up, possibly re-created with a new index
+    auto oldId = interface->tinsInterface.id();
+    if (!interface->refresh()) return;
+
+    LOGGER_INFO("interface {} up", name);
+    interface->up = true;
+    if (interface->tinsInterface.id() != oldId) Sniffer::restartCapture(interface);
+    RouteManager::resumeInterface(interface);
+}
+
+void LinkMonitor::resync() {
+    std::unordered_set<std::string> names;
+    {
+        std::lock_guard lock(mutex);
+        names = LinkMonitor::names;
+    }
+
+    for (const auto &name : names) {
+        auto index = if_nametoindex(name.c_str());
+        onLinkChange(name, index != 0, index != 0 && isRunning(name));
+    }
+}
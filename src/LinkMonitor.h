@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <vector>
+#include <unordered_set>
+
+// Follows the configured interfaces being added, removed, brought up or down, from the
+// RTNLGRP_LINK netlink group. Interfaces missing on start are added once they appear, and
+// routes on a down or removed interface are kept without probing until it's back.
+class LinkMonitor {
+    inline static bool enabled = false;
+    inline static std::mutex mutex;
+    inline static std::unordered_set<std::string> names;
+
+    static void monitorLoop(int fd);
+    // On the main loop
+    static void onLinkChange(const std::string &name, bool exists, bool up);
+    static void resync();
+
+public:
+    static void initialize(const std::vector<std::string> &names);
+    static bool isEnabled();
+    // Up with a carrier (IFF_UP and IFF_RUNNING), as the link notifications are read
+    static bool isRunning(const std::string &name);
+    // Follow another list of interfaces, on reload
+    static void setNames(const std::vector<std::string> &names);
+};
@@ -0,0 +1,74 @@
+#include "LocationHistory.h"
+
+#include "Logger.h"
+
+template <typename Key>
+void LocationHistory::BoundedMap<Key>::set(const Key &key, const std::shared_ptr<Interface> &interface, size_t capacity) {
+    auto [it, inserted] = entries.insert_or_assign(key, interface);
+    if (!inserted) return;
+
+    order.push_back(key);
+    shrink(capacity);
+}
+
+template <typename Key>
+void LocationHistory::BoundedMap<Key>::shrink(size_t capacity) {
+    while (order.size() > capacity) {
+        entries.erase(order.front());
+        order.pop_front();
+    }
+}
+
+template <typename Key>
+std::shared_ptr<Interface> LocationHistory::BoundedMap<Key>::get(const Key &key) const {
+    auto it = entries.find(key);
+    return it == entries.end() ? nullptr : it->second.lock();
+}
+
+void LocationHistory::initialize(size_t capacity, std::chrono::milliseconds fallbackTimeout) {
+    LocationHistory::capacity = capacity;
+    LocationHistory::fallbackTimeout = fallbackTimeout;
+    byAddress.shrink(capacity);
+    byInterfaceId.shrink(capacity);
+    byMacAddress.shrink(capacity);
+
+    if (capacity != 0)
+        LOGGER_INFO("targeted NS enabled, {} history entries, fall back to all interfaces after {} ms", capacity, fallbackTimeout.count());
+}
+
+uint64_t LocationHistory::getInterfaceId(const Tins::IPv6Address &address) {
+    uint64_t id = 0;
+    for (auto p = address.begin() + 8; p != address.end(); p++) id = (id << 8) | *p;
+    return id;
+}
+
+uint64_t LocationHistory::toKey(const Tins::HWAddress<6> &macAddress) {
+    uint64_t key = 0;
+    for (auto byte : macAddress) key = (key << 8) | byte;
+    return key;
+}
+
+void LocationHistory::record(const Tins::IPv6Address &address, const Tins::HWAddress<6> &macAddress, const std::shared_ptr<Interface> &interface) {
+    if (!isEnabled()) return;
+
+    // Link-local addresses are the same on every link, but their interface IDs aren't
+    if (!isLinkLocal(address)) byAddress.set(address, interface, capacity);
+    byInterfaceId.set(getInterfaceId(address), interface, capacity);
+    byMacAddress.set(toKey(macAddress), interface, capacity);
+}
+
+std::shared_ptr<Interface> LocationHistory::guess(const Tins::IPv6Address &address) {
+    if (auto interface = byAddress.get(address)) return interface;
+
+    // The same host in another prefix, or its link-local address
+    auto interfaceId = getInterfaceId(address);
+    if (auto interface = byInterfaceId.get(interfaceId)) return interface;
+
+    // Modified EUI-64, the MAC address with ff:fe inserted in the middle and the U/L bit flipped
+    if (((interfaceId >> 24) & 0xffff) == 0xfffe) {
+        auto macKey = (((interfaceId >> 16) & 0xffffff000000) ^ 0x020000000000) | (interfaceId & 0xffffff);
+        if (auto interface = byMacAddress.get(macKey)) return interface;
+    }
+
+    return nullptr;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <tins/tins.h>
+
+#include "Interface.h"
+
+// Where addresses, interface IDs and MAC addresses were last seen, kept after their routes expire.
+// An NS for an unknown target is sent to the likely interface first, instead of all of them.
+class LocationHistory {
+    // Oldest entries are dropped first when full, refreshing an entry doesn't reorder it
+    template <typename Key>
+    class BoundedMap {
+        std::unordered_map<Key, std::weak_ptr<Interface>> entries;
+        std::deque<Key> order;
+
+    public:
+        void set(const Key &key, const std::shared_ptr<Interface> &interface, size_t capacity);
+        void shrink(size_t capacity);
+        std::shared_ptr<Interface> get(const Key &key) const;
+    };
+
+    inline static size_t capacity = 0;
+    inline static std::chrono::milliseconds fallbackTimeout{0};
+
+    inline static BoundedMap<Tins::IPv6Address> byAddress;
+    inline static BoundedMap<uint64_t> byInterfaceId;
+    inline static BoundedMap<uint64_t> byMacAddress;
+
+    static uint64_t getInterfaceId(const Tins::IPv6Address &address);
+    static uint64_t toKey(const Tins::HWAddress<6> &macAddress);
+
+public:
+    // Disabled if the capacity is 0. Called again on reload, the history is kept within the new capacity
+    static void initialize(size_t capacity, std::chrono::milliseconds fallbackTimeout);
+    static bool isEnabled() {
+        return capacity != 0;
+    }
+    static std::chrono::milliseconds getFallbackTimeout() {
+        return fallbackTimeout;
+    }
+
+    // A host with the address and MAC address was seen on the interface
+    static void record(const Tins::IPv6Address &address, const Tins::HWAddress<6> &macAddress, const std::shared_ptr<Interface> &interface);
+    // The likely interface of the address, by the address itself, then its interface ID, then
+    // the MAC address embedded in an EUI-64 interface ID
+    static std::shared_ptr<Interface> guess(const Tins::IPv6Address &address);
+};
@@ -0,0 +1,207 @@
+#include "Logger.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include <signal.h>
+#include <syslog.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Ensure/Ensure.h"
+#include "TerminalColor/TerminalColor.h"
+
+// Bounded MPMC queue by Dmitry Vyukov, used with a single consumer. Each slot's sequence tells
+// whether it's free for the producer at that position, or filled for the consumer.
+struct LogRecord {
+    std::atomic<size_t> sequence;
+    Logger::LogLevel level;
+    uint32_t length;
+    char message[Logger::MESSAGE_SIZE];
+};
+
+static constexpr size_t RING_SIZE = 2048;
+static_assert((RING_SIZE & (RING_SIZE - 1)) == 0);
+
+static LogRecord ring[RING_SIZE];
+alignas(64) static std::atomic<size_t> enqueuePosition = 0;
+alignas(64) static std::atomic<size_t> writtenPosition = 0;
+alignas(64) static std::atomic<uint64_t> droppedCount = 0;
+
+static std::atomic<bool> started = false;
+static std::atomic<bool> sleeping = false;
+static std::mutex wakeMutex;
+static std::condition_variable wakeCondition;
+
+static Logger::Target target = Logger::STDERR;
+static int outputFd = STDERR_FILENO;
+
+static const char *LEVEL_NAMES[] = {"Error", "Warning", "Info", "Verbose", "Debug"};
+static const TerminalColor LEVEL_COLORS[] = {
+    TerminalColor::ForegroundRed,
+    TerminalColor::ForegroundYellow,
+    TerminalColor::ForegroundBlue,
+    TerminalColor::ForegroundMagenta,
+    TerminalColor::ForegroundWhite
+};
+static const int SYSLOG_PRIORITIES[] = {LOG_ERR, LOG_WARNING, LOG_INFO, LOG_DEBUG, LOG_DEBUG};
+
+static void appendLine(std::string &buffer, Logger::LogLevel level, const char *message, size_t length) {
+    if (target == Logger::LOGFILE) {
+        char time[32];
+        auto now = std::time(nullptr);
+        std::tm tm;
+        std::strftime(time, sizeof(time), "%Y-%m-%d %H:%M:%S ", localtime_r(&now, &tm));
+        buffer += time;
+        buffer += LEVEL_NAMES[level];
+        buffer += ": ";
+    } else {
+        fmt::format_to(
+            std::back_inserter(buffer), "\033[{}m\033[{}m{}: \033[{}m",
+            (int)TerminalColor::Reset, (int)LEVEL_COLORS[level], LEVEL_NAMES[level], (int)TerminalColor::Reset
+        );
+    }
+    buffer.append(message, length);
+    buffer += '\n';
+}
+
+static void writeOutput(const std::string &buffer) {
+    for (size_t written = 0; written < buffer.length(); ) {
+        auto size = write(outputFd, buffer.data() + written, buffer.length() - written);
+        if (size < 0 && errno == EINTR) continue;
+        if (size <= 0) return;
+        written += size;
+    }
+}
+
+static void writeRecord(Logger::LogLevel level, const char *message, size_t length, std::string &buffer) {
+    if (target == Logger::SYSLOG) {
+        syslog(SYSLOG_PRIORITIES[level], "%.*s", (int)length, message);
+    } else {
+        appendLine(buffer, level, message, length);
+    }
+}
+
+static void loggerLoop() {
+    sigset_t signals;
+    sigfillset(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    size_t position = 0;
+    uint64_t reportedDropped = 0;
+    std::string buffer;
+    while (true) {
+        // Drain everything available into one write
+        buffer.clear();
+        auto batchStart = position;
+        while (true) {
+            auto &record = ring[position & (RING_SIZE - 1)];
+            if (record.sequence.load(std::memory_order_acquire) != position + 1) break;
+
+            writeRecord(record.level, record.message, record.length, buffer);
+            record.sequence.store(position + RING_SIZE, std::memory_order_release);
+            position++;
+        }
+
+        if (auto dropped = droppedCount.load(std::memory_order_relaxed); dropped != reportedDropped) {
+            auto message = fmt::format("log ring full, dropped {} messages", dropped - reportedDropped);
+            writeRecord(Logger::WARNING, message.data(), message.length(), buffer);
+            reportedDropped = dropped;
+        }
+
+        if (!buffer.empty()) writeOutput(buffer);
+
+        if (position != batchStart) {
+            writtenPosition.store(position, std::memory_order_release);
+            continue;
+        }
+
+        // Idle. Producers only notify when we're sleeping, the timeout covers a racing wakeup
+        std::unique_lock lock(wakeMutex);
+        sleeping.store(true, std::memory_order_seq_cst);
+        wakeCondition.wait_for(lock, std::chrono::milliseconds(100));
+        sleeping.store(false, std::memory_order_relaxed);
+    }
+}
+
+void Logger::push(LogLevel logLevel, const char *message, size_t length) {
+    if (!started.load(std::memory_order_acquire)) {
+        std::string buffer;
+        appendLine(buffer, logLevel, message, length);
+        writeOutput(buffer);
+        return;
+    }
+
+    auto position = enqueuePosition.load(std::memory_order_relaxed);
+    LogRecord *record;
+    while (true) {
+        record = &ring[position & (RING_SIZE - 1)];
+        auto sequence = record->sequence.load(std::memory_order_acquire);
+        auto difference = (intptr_t)sequence - (intptr_t)position;
+        if (difference == 0) {
+            if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+        } else if (difference < 0) {
+            // Full
+            droppedCount.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            position = enqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+
+    record->level = logLevel;
+    record->length = length;
+    std::memcpy(record->message, message, length);
+    record->sequence.store(position + 1, std::memory_order_release);
+
+    if (sleeping.load(std::memory_order_seq_cst)) wakeCondition.notify_one();
+}
+
+void Logger::setLevel(LogLevel showLevel) {
+    if (showLevel > LOGGER_MAX_LEVEL) {
+        Logger::showLevel = static_cast<LogLevel>(LOGGER_MAX_LEVEL);
+        LOGGER_WARNING("log level {} is not compiled in, showing up to {}", LEVEL_NAMES[showLevel], LEVEL_NAMES[LOGGER_MAX_LEVEL]);
+    } else {
+        Logger::showLevel = showLevel;
+    }
+}
+
+void Logger::initialize(LogLevel showLevel, Target target, const std::string &path) {
+    setLevel(showLevel);
+
+    ::target = target;
+    if (target == LOGFILE) {
+        ENSURE_ERRNO(outputFd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644));
+    } else if (target == SYSLOG) {
+        openlog("magpie", LOG_PID, LOG_DAEMON);
+    }
+
+    for (size_t i = 0; i < RING_SIZE; i++)
+        ring[i].sequence.store(i, std::memory_order_relaxed);
+
+    std::thread(loggerLoop).detach();
+    started.store(true, std::memory_order_release);
+
+    // Don't lose the last messages before exit()
+    ENSURE_ERRNO(std::atexit(Logger::flush));
+}
+
+void Logger::flush() {
+    if (!started.load(std::memory_order_acquire)) return;
+
+    // Give up after a while in case the target is stuck
+    auto target = enqueuePosition.load(std::memory_order_acquire);
+    for (size_t i = 0; i < 1000 && writtenPosition.load(std::memory_order_acquire) < target; i++) {
+        wakeCondition.notify_one();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+uint64_t Logger::getDroppedCount() {
+    return droppedCount.load(std::memory_order_relaxed);
+}
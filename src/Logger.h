@@ -1,13 +1,23 @@
 #pragma once
 
 #include <utility>
-#include <mutex>
-#include <iostream>
+#include <string>
+#include <cstdint>
+#include <atomic>
+#include <algorithm>
 #include <fmt/format.h>
 
-#include "TerminalColor/TerminalColor.h"
 #include "LoggerFormatter.h"
 
+// Levels above this are compiled out, set with -DMAGPIE_LOG_LEVEL in CMake
+#ifndef LOGGER_MAX_LEVEL
+#define LOGGER_MAX_LEVEL 4
+#endif
+
+// Messages are formatted on the caller's thread into a fixed-size record and pushed into a
+// lock-free ring. A background thread drains the ring in batches to the target, so logging
+// never blocks on a slow stderr or journald. When the ring is full the message is dropped
+// and counted instead.
 class Logger {
 public:
     enum LogLevel {
@@ -18,42 +28,56 @@ public:
         DEBUG = 4
     };
 
-    inline static LogLevel showLevel;
+    enum Target {
+        STDERR,
+        SYSLOG,
+        LOGFILE
+    };
 
-private:
-    inline static std::mutex mutex;
+    // Longer messages are truncated
+    static constexpr size_t MESSAGE_SIZE = 496;
 
-    template <typename ...T>
-    static void log(LogLevel logLevel, TerminalColor levelColor, const char *levelName, const char *format, T &&...args) {
-        if (logLevel > showLevel) return;
-        auto formatted = fmt::format(format, std::forward<T>(args)...);
-
-        {
-            std::lock_guard lock(mutex);
-            std::cerr << TerminalColor::Reset << levelColor
-                      << levelName << ": "
-                      << TerminalColor::Reset
-                      << formatted
-                      << std::endl;
-        }
-    }
+    // Changed on reload while other threads log
+    inline static std::atomic<LogLevel> showLevel;
+
+private:
+    // Copy a formatted message into the ring, or write it directly before the logger thread starts
+    static void push(LogLevel logLevel, const char *message, size_t length);
 
 public:
-    static void initialize(LogLevel showLevel) {
-        Logger::showLevel = showLevel;
+    // Start the logger thread writing to the target. The path is used by the file target only
+    static void initialize(LogLevel showLevel, Target target = STDERR, const std::string &path = "");
+    static void setLevel(LogLevel showLevel);
+    // Wait for all messages logged before to be written
+    static void flush();
+    static uint64_t getDroppedCount();
+
+    // For skipping work done only to log, e.g. a loop of log statements
+    static bool isEnabled(LogLevel logLevel) {
+        return logLevel <= LOGGER_MAX_LEVEL && logLevel <= showLevel.load(std::memory_order_relaxed);
     }
 
-#define LOG_FUNCTION(method, level, levelColor, levelName) \
-    template <typename ...T> \
-    inline static void (method)(const char *format, T &&...args) { \
-        log((level), (levelColor), (levelName), format, std::forward<T>(args)...); \
+    // Use the LOGGER_* macros instead, which skip evaluating the arguments when the level is off
+    template <typename ...T>
+    static void log(LogLevel logLevel, const char *format, T &&...args) {
+        char message[MESSAGE_SIZE];
+        auto result = fmt::format_to_n(message, sizeof(message), format, std::forward<T>(args)...);
+        if (result.size > sizeof(message)) {
+            message[sizeof(message) - 3] = message[sizeof(message) - 2] = message[sizeof(message) - 1] = '.';
+        }
+        push(logLevel, message, std::min(result.size, sizeof(message)));
     }
+};
 
-    LOG_FUNCTION(error, ERROR, TerminalColor::ForegroundRed, "Error")
-    LOG_FUNCTION(warning, WARNING, TerminalColor::ForegroundYellow, "Warning")
-    LOG_FUNCTION(info, INFO, TerminalColor::ForegroundBlue, "Info")
-    LOG_FUNCTION(verbose, VERBOSE, TerminalColor::ForegroundMagenta, "Verbose")
-    LOG_FUNCTION(debug, DEBUG, TerminalColor::ForegroundWhite, "Debug")
+#define LOGGER_LOG(level, ...) \
+    do { \
+        if constexpr ((level) <= LOGGER_MAX_LEVEL) { \
+            if ((level) <= Logger::showLevel.load(std::memory_order_relaxed)) Logger::log((level), __VA_ARGS__); \
+        } \
+    } while (false)
 
-#undef LOG_FUNCTION
-};
+#define LOGGER_ERROR(...)   LOGGER_LOG(Logger::ERROR, __VA_ARGS__)
+#define LOGGER_WARNING(...) LOGGER_LOG(Logger::WARNING, __VA_ARGS__)
+#define LOGGER_INFO(...)    LOGGER_LOG(Logger::INFO, __VA_ARGS__)
+#define LOGGER_VERBOSE(...) LOGGER_LOG(Logger::VERBOSE, __VA_ARGS__)
+#define LOGGER_DEBUG(...)   LOGGER_LOG(Logger::DEBUG, __VA_ARGS__)
@@ -0,0 +1,290 @@
+#include "Metrics.h"
+
+#include <cstring>
+#include <thread>
+#include <signal.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fmt/format.h>
+
+#include "Ensure/Ensure.h"
+#include "Logger.h"
+#include "PacketTrace.h"
+
+size_t Histogram::bucketIndex(uint64_t value) {
+    if (value < SUB_BUCKETS * 2) return value;
+
+    size_t msb = 63 - __builtin_clzll(value);
+    if (msb >= MAX_VALUE_BITS) return BUCKETS - 1;
+
+    size_t exponent = msb - SUB_BUCKET_BITS;
+    return (exponent + 1) * SUB_BUCKETS + ((value >> exponent) & (SUB_BUCKETS - 1));
+}
+
+uint64_t Histogram::bucketUpperBound(size_t index) {
+    if (index < SUB_BUCKETS * 2) return index;
+
+    size_t exponent = index / SUB_BUCKETS - 1;
+    uint64_t subBucket = index % SUB_BUCKETS;
+    return ((SUB_BUCKETS + subBucket + 1) << exponent) - 1;
+}
+
+void Histogram::record(uint64_t microseconds) {
+    buckets[bucketIndex(microseconds)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(microseconds, std::memory_order_relaxed);
+}
+
+uint64_t Histogram::getCount() const {
+    return count.load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::getSum() const {
+    return sum.load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::percentile(double q) const {
+    uint64_t total = 0;
+    for (const auto &bucket : buckets) total += bucket.load(std::memory_order_relaxed);
+    if (total == 0) return 0;
+
+    auto rank = std::max<uint64_t>(q * total + 0.5, 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) return bucketUpperBound(i);
+    }
+
+    return bucketUpperBound(BUCKETS - 1);
+}
+
+uint64_t Histogram::countUpTo(uint64_t microseconds) const {
+    uint64_t result = 0;
+    for (size_t i = 0; i < BUCKETS - 1 && bucketUpperBound(i) <= microseconds; i++)
+        result += buckets[i].load(std::memory_order_relaxed);
+    return result;
+}
+
+std::shared_ptr<Metrics::InterfaceMetrics> Metrics::forInterface(const std::string &name) {
+    std::lock_guard lock(mutex);
+    auto &metrics = interfaceMetrics[name];
+    if (!metrics) metrics = std::make_shared<InterfaceMetrics>();
+    return metrics;
+}
+
+void Metrics::registerGauge(const std::string &name, std::function<int64_t ()> callback) {
+    std::lock_guard lock(mutex);
+    callbackGauges[name] = callback;
+}
+
+static void renderCounter(std::string &output, const char *name, const char *help, const Counter &counter) {
+    fmt::format_to(std::back_inserter(output), "# HELP {0} {1}\n# TYPE {0} counter\n{0} {2}\n", name, help, counter.get());
+}
+
+static void renderGauge(std::string &output, const char *name, const char *help, int64_t value) {
+    fmt::format_to(std::back_inserter(output), "# HELP {0} {1}\n# TYPE {0} gauge\n{0} {2}\n", name, help, value);
+}
+
+void Metrics::renderHistogram(std::string &output, const char *name, const std::string &labels, const Histogram &histogram, uint64_t firstBound, uint64_t lastBound) {
+    auto separator = labels.empty() ? "" : ",";
+
+    // Exported buckets are powers of 4 microseconds, from 1us to ~17s by default, which are exact bucket boundaries
+    for (uint64_t bound = firstBound; bound <= lastBound; bound *= 4)
+        fmt::format_to(std::back_inserter(output), "{}_bucket{{{}{}le=\"{}\"}} {}\n", name, labels, separator, bound / 1e6, histogram.countUpTo(bound));
+
+    auto labelSet = labels.empty() ? "" : "{" + labels + "}";
+    fmt::format_to(
+        std::back_inserter(output),
+        "{0}_bucket{{{1}{2}le=\"+Inf\"}} {3}\n{0}_sum{4} {5}\n{0}_count{4} {3}\n",
+        name, labels, separator, histogram.getCount(), labelSet, histogram.getSum() / 1e6
+    );
+}
+
+static void renderHistogramFamily(std::string &output, const char *name, const char *help, const Histogram &histogram, uint64_t firstBound = 1, uint64_t lastBound = 1ull << 24) {
+    fmt::format_to(std::back_inserter(output), "# HELP {0} {1}\n# TYPE {0} histogram\n", name, help);
+    Metrics::renderHistogram(output, name, "", histogram, firstBound, lastBound);
+}
+
+std::string Metrics::render() {
+    std::string output;
+    auto out = std::back_inserter(output);
+
+    {
+        std::lock_guard lock(mutex);
+
+        output += "# HELP magpie_packets_received_total NDP packets received.\n# TYPE magpie_packets_received_total counter\n";
+        for (const auto &[name, metrics] : interfaceMetrics)
+            for (size_t type = 0; type < MESSAGE_TYPE_COUNT; type++)
+                fmt::format_to(out, "magpie_packets_received_total{{interface=\"{}\",type=\"{}\"}} {}\n", name, MESSAGE_TYPE_NAMES[type], metrics->received[type].get());
+
+        output += "# HELP magpie_packets_sent_total NDP packets sent.\n# TYPE magpie_packets_sent_total counter\n";
+        for (const auto &[name, metrics] : interfaceMetrics)
+            for (size_t type = 0; type < MESSAGE_TYPE_COUNT; type++)
+                fmt::format_to(out, "magpie_packets_sent_total{{interface=\"{}\",type=\"{}\"}} {}\n", name, MESSAGE_TYPE_NAMES[type], metrics->sent[type].get());
+
+        for (const auto &[name, callback] : callbackGauges)
+            fmt::format_to(out, "# TYPE {0} gauge\n{0} {1}\n", name, callback());
+    }
+
+    renderCounter(output, "magpie_ns_replied_total", "NS replied from the route table.", nsReplied);
+    renderCounter(output, "magpie_ns_kernel_answered_total", "NS for known routes left to the kernel proxy neighbor entries.", nsKernelAnswered);
+    renderCounter(output, "magpie_ns_forwarded_total", "NS for unknown targets forwarded to other interfaces.", nsForwarded);
+    renderCounter(output, "magpie_ns_targeted_total", "NS sent only to the interface the target was last seen on.", nsTargeted);
+    renderCounter(output, "magpie_ns_fallback_total", "Targeted NS not answered in time and sent to all interfaces.", nsFallback);
+    renderCounter(output, "magpie_dad_defended_total", "DAD answered for addresses in use on another interface.", dadDefended);
+    renderCounter(output, "magpie_dad_forwarded_total", "DAD forwarded to other interfaces.", dadForwarded);
+    renderCounter(output, "magpie_dad_learned_total", "Hosts learned provisionally after their DAD completed.", dadLearned);
+    renderCounter(output, "magpie_na_forwarded_total", "Multicast NA forwarded to other interfaces.", naForwarded);
+    renderCounter(output, "magpie_du_probed_total", "Destination unreachable messages probed.", duProbed);
+    renderCounter(output, "magpie_link_local_ignored_total", "Packets ignored for link-local targets.", linkLocalIgnored);
+    renderCounter(output, "magpie_decode_errors_total", "Packets failed to decode.", decodeErrors);
+
+    renderGauge(output, "magpie_routes", "Routes in the route table.", routes.get());
+    renderGauge(output, "magpie_provisional_routes", "Provisional routes waiting for confirmation.", provisionalRoutes.get());
+    renderCounter(output, "magpie_routes_added_total", "Routes added.", routesAdded);
+    renderCounter(output, "magpie_routes_moved_total", "Routes moved to another interface.", routesMoved);
+    renderCounter(output, "magpie_routes_expired_total", "Routes deleted as expired.", routesExpired);
+    renderCounter(output, "magpie_probes_sent_total", "Re-probes sent for existing routes.", probesSent);
+    renderCounter(output, "magpie_probes_confirmed_total", "Re-probed routes confirmed by NA.", probesConfirmed);
+    renderGauge(output, "magpie_hosts", "MAC addresses the routes are grouped by.", hosts.get());
+    renderCounter(output, "magpie_probes_coalesced_total", "Re-probes skipped as another address of the same MAC address was confirmed.", probesCoalesced);
+    renderHistogramFamily(output, "magpie_route_install_duration_seconds", "Time to program a route into the kernel.", routeInstallLatency);
+    // From ~1s to ~19h
+    renderHistogramFamily(output, "magpie_probe_interval_seconds", "Adapted interval of the routes re-probed.", probeIntervals, 1ull << 20, 1ull << 36);
+    renderCounter(output, "magpie_snapshots_written_total", "Route snapshots written.", snapshotsWritten);
+    renderGauge(output, "magpie_last_snapshot_bytes", "Size of the last route snapshot.", lastSnapshotBytes.get());
+    renderGauge(output, "magpie_last_snapshot_duration_microseconds", "Time taken by the last route snapshot.", lastSnapshotMicroseconds.get());
+
+    renderCounter(output, "magpie_replication_sent_total", "Replication datagrams sent to the peer.", replicationSent);
+    renderCounter(output, "magpie_replication_received_total", "Replication datagrams received from the peer.", replicationReceived);
+    renderCounter(output, "magpie_replication_dropped_total", "Replication datagrams failed to send.", replicationDropped);
+    renderCounter(output, "magpie_replication_resyncs_total", "Snapshots of all routes sent to the standby.", replicationResyncs);
+    renderGauge(output, "magpie_replicated_routes", "Routes kept from the active peer while standby.", replicatedRoutes.get());
+    renderGauge(output, "magpie_replication_standby", "1 if standby, 0 if active.", replicationStandby.get());
+
+    renderGauge(output, "magpie_pending_requests", "NS requests waiting for NA.", pendingRequests.get());
+    renderCounter(output, "magpie_requests_added_total", "NS requests saved for later response.", requestsAdded);
+    renderCounter(output, "magpie_requests_answered_total", "NS requests answered.", requestsAnswered);
+    renderCounter(output, "magpie_requests_expired_total", "NS requests expired without answer.", requestsExpired);
+
+    fmt::format_to(
+        out, "# HELP {0} {1}\n# TYPE {0} counter\n{0} {2}\n",
+        "magpie_log_messages_dropped_total", "Log messages dropped on a full log ring.", Logger::getDroppedCount()
+    );
+
+    PacketTrace::render(output);
+
+    return output;
+}
+
+void Metrics::initialize(const std::string &listenAddress, int inheritedSocket) {
+    if (inheritedSocket >= 0) {
+        LOGGER_INFO("serving metrics on {} taken over from the previous process", listenAddress);
+        listeningSocket = inheritedSocket;
+        std::thread(serveLoop, inheritedSocket).detach();
+        return;
+    }
+
+    int fd;
+
+    constexpr auto UNIX_PREFIX = "unix:";
+    if (listenAddress.rfind(UNIX_PREFIX, 0) == 0) {
+        auto path = listenAddress.substr(strlen(UNIX_PREFIX));
+
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (path.length() >= sizeof(address.sun_path)) {
+            LOGGER_ERROR("metrics socket path too long: {}", path);
+            exit(1);
+        }
+        strcpy(address.sun_path, path.c_str());
+
+        ENSURE_ERRNO(fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+        unlink(path.c_str());
+        ENSURE_ERRNO(bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)));
+    } else {
+        // "host:port", "[v6 host]:port" or ":port"
+        auto colon = listenAddress.rfind(':');
+        if (colon == std::string::npos) {
+            LOGGER_ERROR("invalid metrics listen address: {}", listenAddress);
+            exit(1);
+        }
+
+        auto host = listenAddress.substr(0, colon);
+        auto port = listenAddress.substr(colon + 1);
+        if (host.length() >= 2 && host.front() == '[' && host.back() == ']') host = host.substr(1, host.length() - 2);
+
+        addrinfo hints = {}, *result;
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        if (int error = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result); error != 0) {
+            LOGGER_ERROR("invalid metrics listen address {}: {}", listenAddress, gai_strerror(error));
+            exit(1);
+        }
+
+        ENSURE_ERRNO(fd = socket(result->ai_family, result->ai_socktype | SOCK_CLOEXEC, result->ai_protocol));
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        ENSURE_ERRNO(bind(fd, result->ai_addr, result->ai_addrlen));
+        freeaddrinfo(result);
+    }
+
+    ENSURE_ERRNO(listen(fd, 16));
+    LOGGER_INFO("serving metrics on {}", listenAddress);
+
+    listeningSocket = fd;
+
+    std::thread(serveLoop, fd).detach();
+}
+
+int Metrics::getListeningSocket() {
+    return listeningSocket;
+}
+
+void Metrics::serveLoop(int listenFd) {
+    // Signal handlers touch the routing table, never run them on this thread
+    sigset_t signals;
+    sigfillset(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    while (true) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) continue;
+
+        // Don't let a stuck client block the exposition
+        timeval timeout = {1, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        // Any request gets the metrics, only wait for the end of request headers
+        std::string request;
+        char buffer[1024];
+        while (request.find("\r\n\r\n") == std::string::npos && request.length() < 8192) {
+            auto size = read(fd, buffer, sizeof(buffer));
+            if (size <= 0) break;
+            request.append(buffer, size);
+        }
+
+        auto body = render();
+        auto response = fmt::format(
+            "HTTP/1.0 200 OK\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: {}\r\n"
+            "Connection: close\r\n"
+            "\r\n"
+            "{}",
+            body.length(), body
+        );
+
+        for (size_t written = 0; written < response.length(); ) {
+            auto size = write(fd, response.data() + written, response.length() - written);
+            if (size <= 0) break;
+            written += size;
+        }
+
+        close(fd);
+    }
+}
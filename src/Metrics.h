@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <map>
+#include <functional>
+
+// Counters and histograms are updated with relaxed atomics only, they're written by the
+// packet thread and read by the exposition thread.
+class Counter {
+    std::atomic<uint64_t> value = 0;
+
+public:
+    void increment(uint64_t n = 1) {
+        value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+};
+
+class Gauge {
+    std::atomic<int64_t> value = 0;
+
+public:
+    void set(int64_t newValue) {
+        value.store(newValue, std::memory_order_relaxed);
+    }
+
+    void add(int64_t n) {
+        value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    int64_t get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+};
+
+// HDR-style log-linear histogram of microseconds. Each power of two range is split into
+// SUB_BUCKETS linear sub-buckets, so any recorded value is kept within 1/SUB_BUCKETS relative error.
+class Histogram {
+public:
+    static constexpr size_t SUB_BUCKET_BITS = 3;
+    static constexpr size_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    // Values up to 2^36 us (~19 hours) are distinguished, larger ones go to the last bucket
+    static constexpr size_t MAX_VALUE_BITS = 36;
+    static constexpr size_t BUCKETS = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets = {};
+    std::atomic<uint64_t> count = 0;
+    std::atomic<uint64_t> sum = 0;
+
+    static size_t bucketIndex(uint64_t value);
+    static uint64_t bucketUpperBound(size_t index);
+
+public:
+    void record(uint64_t microseconds);
+
+    uint64_t getCount() const;
+    uint64_t getSum() const;
+    // Upper bound of the bucket containing the q-th quantile (0 <= q <= 1)
+    uint64_t percentile(double q) const;
+    // Number of values in the buckets ending at the bound or below, for a cumulative "le" bucket.
+    // Values too large to be distinguished only count toward +Inf
+    uint64_t countUpTo(uint64_t microseconds) const;
+};
+
+class Metrics {
+public:
+    enum MessageType {
+        NS,
+        NA,
+        DU,
+        MESSAGE_TYPE_COUNT
+    };
+
+    static constexpr const char *MESSAGE_TYPE_NAMES[MESSAGE_TYPE_COUNT] = {"ns", "na", "du"};
+
+    struct InterfaceMetrics {
+        Counter received[MESSAGE_TYPE_COUNT];
+        Counter sent[MESSAGE_TYPE_COUNT];
+    };
+
+    // Sniffer
+    inline static Counter nsReplied, nsForwarded, naForwarded, duProbed, linkLocalIgnored, decodeErrors;
+    inline static Counter nsTargeted, nsFallback;
+    inline static Counter dadDefended, dadForwarded, dadLearned;
+    inline static Counter nsKernelAnswered;
+
+    // RouteManager
+    inline static Gauge routes, provisionalRoutes;
+    inline static Counter routesAdded, routesMoved, routesExpired;
+    inline static Counter probesSent, probesConfirmed;
+    inline static Gauge hosts;
+    inline static Counter probesCoalesced;
+    inline static Histogram routeInstallLatency;
+    // The adapted interval of each first re-probe of a route
+    inline static Histogram probeIntervals;
+    inline static Gauge lastSnapshotBytes, lastSnapshotMicroseconds;
+    inline static Counter snapshotsWritten;
+
+    // Replication
+    inline static Counter replicationSent, replicationReceived, replicationDropped, replicationResyncs;
+    inline static Gauge replicatedRoutes, replicationStandby;
+
+    // RequestManager
+    inline static Gauge pendingRequests;
+    inline static Counter requestsAdded, requestsAnswered, requestsExpired;
+
+private:
+    inline static std::mutex mutex;
+    inline static std::map<std::string, std::shared_ptr<InterfaceMetrics>> interfaceMetrics;
+    inline static std::map<std::string, std::function<int64_t ()>> callbackGauges;
+    inline static int listeningSocket = -1;
+
+    static void serveLoop(int listenFd);
+    static std::string render();
+
+public:
+    // Get (or create) the counters for an interface by name, kept across interface re-creation
+    static std::shared_ptr<InterfaceMetrics> forInterface(const std::string &name);
+    // Register a gauge whose value is computed on each scrape. The callback must be thread safe
+    static void registerGauge(const std::string &name, std::function<int64_t ()> callback);
+
+    // Render one series of a histogram family, labels formatted as 'a="x",b="y"'. The buckets are
+    // powers of 4 microseconds between the bounds, which must be powers of 4 as well
+    static void renderHistogram(std::string &output, const char *name, const std::string &labels, const Histogram &histogram, uint64_t firstBound = 1, uint64_t lastBound = 1ull << 24);
+
+    // Serve Prometheus text exposition over HTTP on "host:port" or "unix:/path", or on the listening
+    // socket handed over by the previous process if given
+    static void initialize(const std::string &listenAddress, int inheritedSocket = -1);
+    // -1 if not serving
+    static int getListeningSocket();
+};
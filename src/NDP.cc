@@ -8,7 +8,7 @@ static void fillRequiredIpHeaders(Tins::IPv6 &ip6) {
     ip6.hop_limit(255);
 }
 
-Tins::EthernetII makeNeighborSolicitation(const Interface &sendTo, const Tins::IPv6Address &target) {
+static Tins::EthernetII makeSolicitation(const Interface &sendTo, const Tins::IPv6Address &source, const Tins::IPv6Address &target, bool withSourceLinkLayer) {
     const static auto NS_TARGET_MAC_TEMPLATE = Tins::HWAddress<6>("33:33:ff:AA:BB:CC");
     auto destMac = NS_TARGET_MAC_TEMPLATE;
     for (size_t i = 1; i <= 3; i++) destMac[destMac.address_size - i] = *(target.end() - i);
@@ -17,21 +17,31 @@ Tins::EthernetII makeNeighborSolicitation(const Interface &sendTo, const Tins::I
     auto destIp = NS_TARGET_IP_TEMPLATE;
     for (size_t i = 1; i <= 3; i++) *(destIp.end() - i) = *(target.end() - i);
 
-    auto sourceMac = sendTo.tinsInterface.hw_address();
+    const auto &sourceMac = sendTo.macAddress;
     
     auto eth = Tins::EthernetII(destMac, sourceMac);
-    auto ip6 = Tins::IPv6(destIp, sendTo.linkLocal);
+    auto ip6 = Tins::IPv6(destIp, source);
     auto icmp6 = Tins::ICMPv6(Tins::ICMPv6::NEIGHBOUR_SOLICIT);
     fillRequiredIpHeaders(ip6);
 
     icmp6.target_addr(target);
-    icmp6.add_option(Tins::ICMPv6::option(Tins::ICMPv6::SOURCE_ADDRESS, sourceMac.address_size, sourceMac.begin()));
+    if (withSourceLinkLayer)
+        icmp6.add_option(Tins::ICMPv6::option(Tins::ICMPv6::SOURCE_ADDRESS, sourceMac.address_size, sourceMac.begin()));
 
     return eth / ip6 / icmp6;
 }
 
+Tins::EthernetII makeNeighborSolicitation(const Interface &sendTo, const Tins::IPv6Address &target) {
+    return makeSolicitation(sendTo, sendTo.linkLocal, target, true);
+}
+
+Tins::EthernetII makeDuplicateAddressDetection(const Interface &sendTo, const Tins::IPv6Address &target) {
+    // The option must not be included with the unspecified source
+    return makeSolicitation(sendTo, Tins::IPv6Address(), target, false);
+}
+
 Tins::EthernetII makeNeighborAdvertisement(const Interface &sendTo, const Tins::HWAddress<6> &destMac, const Tins::IPv6Address &destIp, const Tins::IPv6Address &target, bool solicited) {
-    auto sourceMac = sendTo.tinsInterface.hw_address();
+    const auto &sourceMac = sendTo.macAddress;
 
     auto eth = Tins::EthernetII(destMac, sourceMac);
     auto ip6 = Tins::IPv6(destIp, sendTo.linkLocal);
@@ -6,4 +6,6 @@
 #include "tins/ipv6_address.h"
 
 Tins::EthernetII makeNeighborSolicitation(const Interface &sendTo, const Tins::IPv6Address &target);
+// NS for duplicate address detection, from the unspecified address and without our link-layer address
+Tins::EthernetII makeDuplicateAddressDetection(const Interface &sendTo, const Tins::IPv6Address &target);
 Tins::EthernetII makeNeighborAdvertisement(const Interface &sendTo, const Tins::HWAddress<6> &destMac, const Tins::IPv6Address &destIp, const Tins::IPv6Address &target, bool solicited);
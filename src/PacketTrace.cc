@@ -0,0 +1,59 @@
+#include "PacketTrace.h"
+
+#include <algorithm>
+#include <fmt/format.h>
+
+#include "Logger.h"
+
+void PacketTrace::initialize(uint64_t slowThreshold) {
+    PacketTrace::slowThreshold = slowThreshold;
+}
+
+void PacketTrace::finish(const std::string &interfaceName) {
+    int64_t lastTime = captureTime;
+    for (size_t stage = 0; stage < STAGE_COUNT; stage++) {
+        if (stageTimes[stage] == 0) continue;
+
+        // Clock adjustments could make the capture timestamp look in future
+        auto elapsed = std::max<int64_t>(stageTimes[stage] - captureTime, 0);
+        latency[type][outcome][stage].record(elapsed);
+        lastTime = stageTimes[stage];
+    }
+
+    auto total = lastTime - captureTime;
+    if (slowThreshold == 0 || total < (int64_t)slowThreshold) return;
+
+    // Log at most one slow packet per second
+    if (lastTime - lastSlowLogTime < 1000000) {
+        suppressedSlowLogs++;
+        return;
+    }
+    lastSlowLogTime = lastTime;
+
+    std::string stages;
+    for (size_t stage = 0; stage < STAGE_COUNT; stage++) {
+        if (stageTimes[stage] == 0) continue;
+        fmt::format_to(std::back_inserter(stages), ", {} at {:.3f} ms", STAGE_NAMES[stage], (stageTimes[stage] - captureTime) / 1000.0);
+    }
+
+    LOGGER_WARNING(
+        "slow {} from [{}] ({}): {:.3f} ms total{} ({} more slow packets not logged)",
+        Metrics::MESSAGE_TYPE_NAMES[type], interfaceName, OUTCOME_NAMES[outcome], total / 1000.0, stages, suppressedSlowLogs
+    );
+    suppressedSlowLogs = 0;
+}
+
+void PacketTrace::render(std::string &output) {
+    constexpr auto NAME = "magpie_packet_latency_seconds";
+    fmt::format_to(std::back_inserter(output), "# HELP {0} Time from packet capture to each processing stage.\n# TYPE {0} histogram\n", NAME);
+
+    for (size_t type = 0; type < Metrics::MESSAGE_TYPE_COUNT; type++)
+        for (size_t outcome = 0; outcome < OUTCOME_COUNT; outcome++)
+            for (size_t stage = 0; stage < STAGE_COUNT; stage++) {
+                const auto &histogram = latency[type][outcome][stage];
+                if (histogram.getCount() == 0) continue;
+
+                auto labels = fmt::format("type=\"{}\",outcome=\"{}\",stage=\"{}\"", Metrics::MESSAGE_TYPE_NAMES[type], OUTCOME_NAMES[outcome], STAGE_NAMES[stage]);
+                Metrics::renderHistogram(output, NAME, labels, histogram);
+            }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <chrono>
+
+#include "Metrics.h"
+
+// Follows one captured packet through the pipeline, from the kernel capture timestamp to the
+// response sent. Elapsed times of each stage are recorded into histograms by message type and
+// outcome once the packet is done, and slow packets are logged with a sampled rate.
+class PacketTrace {
+public:
+    enum Stage {
+        DEQUEUED,
+        DECIDED,
+        ROUTE_PROGRAMMED,
+        RESPONDED,
+        STAGE_COUNT
+    };
+
+    enum Outcome {
+        REPLIED,
+        FORWARDED,
+        LEARNED,
+        REFRESHED,
+        PROBED,
+        IGNORED,
+        OUTCOME_COUNT
+    };
+
+    static constexpr const char *STAGE_NAMES[STAGE_COUNT] = {"dequeued", "decided", "route_programmed", "responded"};
+    static constexpr const char *OUTCOME_NAMES[OUTCOME_COUNT] = {"replied", "forwarded", "learned", "refreshed", "probed", "ignored"};
+
+    // Elapsed time from capture to each stage
+    inline static Histogram latency[Metrics::MESSAGE_TYPE_COUNT][OUTCOME_COUNT][STAGE_COUNT];
+
+private:
+    inline static uint64_t slowThreshold;
+    inline static int64_t lastSlowLogTime;
+    inline static size_t suppressedSlowLogs;
+
+    int64_t captureTime;
+    int64_t stageTimes[STAGE_COUNT] = {};
+    Metrics::MessageType type;
+    Outcome outcome;
+
+public:
+    // Threshold in microseconds to log a packet as slow, 0 to disable
+    static void initialize(uint64_t slowThreshold);
+    static void render(std::string &output);
+
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    explicit PacketTrace(int64_t captureTime) : captureTime(captureTime), type(Metrics::NS), outcome(IGNORED) {}
+
+    void mark(Stage stage) {
+        stageTimes[stage] = now();
+    }
+
+    void setType(Metrics::MessageType type) {
+        this->type = type;
+    }
+
+    void setOutcome(Outcome outcome) {
+        this->outcome = outcome;
+    }
+
+    // Record the stages reached into histograms
+    void finish(const std::string &interfaceName);
+};
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <queue>
+#include <chrono>
+#include <optional>
 #include <mutex>
 #include <condition_variable>
 
@@ -19,6 +21,11 @@ public:
         cv.notify_one();
     }
 
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return queue.size();
+    }
+
     T pop() {
         std::unique_lock<std::mutex> lock(mutex);
         while (queue.empty()) cv.wait(lock);
@@ -26,4 +33,15 @@ public:
         queue.pop();
         return value;
     }
+
+    // Returns nullopt if nothing is pushed before the deadline
+    template <typename Clock, typename Duration>
+    std::optional<T> pop(const std::chrono::time_point<Clock, Duration> &deadline) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (queue.empty())
+            if (cv.wait_until(lock, deadline) == std::cv_status::timeout && queue.empty()) return std::nullopt;
+        T value = std::move(queue.front());
+        queue.pop();
+        return value;
+    }
 };
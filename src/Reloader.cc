@@ -0,0 +1,133 @@
+#include "Reloader.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "Logger.h"
+#include "Interface.h"
+#include "Sniffer.h"
+#include "RouteManager.h"
+#include "PacketTrace.h"
+#include "LocationHistory.h"
+#include "LinkMonitor.h"
+#include "VlanTrunk.h"
+
+void Reloader::initialize(int argc, char *argv[], const Arguments &arguments) {
+    commandLine.assign(argv, argv + argc);
+    current = arguments;
+}
+
+std::optional<std::string> Reloader::reload() {
+    std::vector<char *> argv;
+    for (auto &word : commandLine) argv.push_back(word.data());
+
+    Arguments arguments;
+    try {
+        arguments = parseArguments(argv.size(), argv.data(), false);
+    } catch (const std::invalid_argument &e) {
+        LOGGER_ERROR("reload failed, keeping the current arguments: {}", e.what());
+        return e.what();
+    }
+    LOGGER_INFO("reloading arguments");
+
+    auto restartNeeded = [] (const char *name, bool changed) {
+        if (changed) LOGGER_WARNING("{} changed, restart to apply", name);
+    };
+    restartNeeded("log target", arguments.logTarget != current.logTarget || arguments.logFile != current.logFile);
+    restartNeeded("routes save file", arguments.routesSaveFile != current.routesSaveFile);
+    restartNeeded("routes save format", arguments.routesSaveFormat != current.routesSaveFormat);
+    restartNeeded("routes save interval", arguments.routesSaveInterval != current.routesSaveInterval);
+    restartNeeded("metrics listen address", arguments.metricsListen != current.metricsListen);
+    restartNeeded("control socket", arguments.controlSocket != current.controlSocket);
+    restartNeeded("trunk", arguments.trunk != current.trunk);
+    restartNeeded("hotplug", arguments.hotplug != current.hotplug);
+    restartNeeded("handoff socket", arguments.handoffSocket != current.handoffSocket);
+    restartNeeded("kernel proxy", arguments.kernelProxy != current.kernelProxy);
+    restartNeeded("replication", arguments.replicationListen != current.replicationListen || arguments.replicationPeer != current.replicationPeer);
+    restartNeeded(
+        "CPU pinning or scheduling",
+        arguments.captureCpus != current.captureCpus ||
+        arguments.processingCpus != current.processingCpus ||
+        arguments.realtimePriority != current.realtimePriority ||
+        arguments.busyPoll != current.busyPoll ||
+        arguments.lockMemory != current.lockMemory
+    );
+
+    Logger::setLevel(arguments.logLevel);
+    PacketTrace::initialize(arguments.slowPacketThreshold * 1000);
+    LocationHistory::initialize(arguments.locationHistory, std::chrono::milliseconds(arguments.targetedNsTimeout));
+    if (Sniffer::setTargetFilter(arguments.prefixes) && Sniffer::isCapturing()) {
+        LOGGER_INFO("target filter changed, restarting captures");
+        Sniffer::stopCaptures();
+        Sniffer::startCaptures();
+    }
+    RouteManager::reconfigure(arguments.alarmInterval, arguments.routeProbeInterval, arguments.routeProbeRetries);
+    RouteManager::adaptProbeInterval(arguments.routeProbeIntervalMin, arguments.routeProbeIntervalMax);
+    RouteManager::groupByMacAddress(arguments.macVerifyInterval);
+    applyInterfaces(arguments.interfaces);
+
+    // Keep the arguments not applied, so they're reported again on the next reload
+    auto applied = arguments;
+    applied.logTarget = current.logTarget;
+    applied.logFile = current.logFile;
+    applied.routesSaveFile = current.routesSaveFile;
+    applied.routesSaveFormat = current.routesSaveFormat;
+    applied.routesSaveInterval = current.routesSaveInterval;
+    applied.metricsListen = current.metricsListen;
+    applied.controlSocket = current.controlSocket;
+    applied.trunk = current.trunk;
+    applied.hotplug = current.hotplug;
+    applied.handoffSocket = current.handoffSocket;
+    applied.kernelProxy = current.kernelProxy;
+    applied.replicationListen = current.replicationListen;
+    applied.replicationPeer = current.replicationPeer;
+    // Changed with the "promote" and "demote" commands at runtime
+    applied.standby = current.standby;
+    applied.captureCpus = current.captureCpus;
+    applied.processingCpus = current.processingCpus;
+    applied.realtimePriority = current.realtimePriority;
+    applied.busyPoll = current.busyPoll;
+    applied.lockMemory = current.lockMemory;
+    current = applied;
+
+    return std::nullopt;
+}
+
+void Reloader::applyInterfaces(const std::vector<std::string> &interfaces) {
+    auto isListed = [&] (const std::string &name) {
+        return std::find(interfaces.begin(), interfaces.end(), name) != interfaces.end();
+    };
+
+    std::vector<std::shared_ptr<Interface>> removed;
+    for (const auto &[name, interface] : Interface::interfaces)
+        if (!isListed(name)) removed.push_back(interface);
+
+    for (const auto &interface : removed) {
+        LOGGER_INFO("interface {} removed from the list", interface->name);
+        interface->up = false;
+        if (interface->capture) interface->capture->stop(*interface);
+        VlanTrunk::detach(*interface);
+        RouteManager::removeInterface(interface);
+        Interface::interfaces.erase(interface->name);
+    }
+
+    if (LinkMonitor::isEnabled()) LinkMonitor::setNames(interfaces);
+
+    for (const auto &name : interfaces) {
+        if (Interface::interfaces.count(name)) continue;
+        if (name == "lo") {
+            LOGGER_ERROR("refuse to relay on loopback interface!");
+            continue;
+        }
+
+        if (auto interface = Interface::tryInitialize(name)) {
+            LOGGER_INFO("interface {} added to the list", name);
+            Sniffer::restartCapture(interface);
+            RouteManager::addInterface(interface);
+        } else if (LinkMonitor::isEnabled()) {
+            LOGGER_WARNING("interface {} not found, waiting for it", name);
+        } else {
+            LOGGER_ERROR("interface {} not found, not added", name);
+        }
+    }
+}
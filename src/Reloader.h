@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <optional>
+
+#include "Arguments.h"
+
+// Parses the arguments again, including the config file, and applies the changes in place
+// without losing routes or pending requests. Arguments only used on start are reported as
+// needing a restart.
+class Reloader {
+    inline static std::vector<std::string> commandLine;
+    inline static Arguments current;
+
+    static void applyInterfaces(const std::vector<std::string> &interfaces);
+
+public:
+    static void initialize(int argc, char *argv[], const Arguments &arguments);
+    // On the main loop. Returns the error if the new arguments are invalid, nothing is changed then
+    static std::optional<std::string> reload();
+};
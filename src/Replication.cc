@@ -0,0 +1,413 @@
+#include "Replication.h"
+
+#include <cstring>
+#include <algorithm>
+#include <thread>
+#include <signal.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+
+#include "Ensure/Ensure.h"
+#include "Logger.h"
+#include "Utils.h"
+#include "Clock.h"
+#include "Sniffer.h"
+#include "RouteManager.h"
+#include "Metrics.h"
+
+// Route changes are batched for this long before sent
+constexpr auto FLUSH_DELAY = std::chrono::milliseconds(100);
+constexpr time_t CHECKSUM_INTERVAL = 10;
+// Datagrams of a snapshot sent at once, the rest after a pause
+constexpr size_t SNAPSHOT_BATCH = 64;
+constexpr auto SNAPSHOT_PAUSE = std::chrono::milliseconds(10);
+
+// "unix:/path", "host:port", "[v6 host]:port" or ":port"
+static bool resolveAddress(const std::string &str, int family, sockaddr_storage &address, socklen_t &length) {
+    address = {};
+
+    constexpr auto UNIX_PREFIX = "unix:";
+    if (str.rfind(UNIX_PREFIX, 0) == 0) {
+        if (family != AF_UNSPEC && family != AF_UNIX) return false;
+
+        auto path = str.substr(strlen(UNIX_PREFIX));
+        auto unixAddress = reinterpret_cast<sockaddr_un *>(&address);
+        if (path.empty() || path.length() >= sizeof(unixAddress->sun_path)) return false;
+        unixAddress->sun_family = AF_UNIX;
+        strcpy(unixAddress->sun_path, path.c_str());
+        length = sizeof(sockaddr_un);
+        return true;
+    }
+
+    if (family == AF_UNIX) return false;
+    auto colon = str.rfind(':');
+    if (colon == std::string::npos) return false;
+
+    auto host = str.substr(0, colon);
+    auto port = str.substr(colon + 1);
+    if (host.length() >= 2 && host.front() == '[' && host.back() == ']') host = host.substr(1, host.length() - 2);
+
+    addrinfo hints = {}, *result;
+    hints.ai_family = family;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_PASSIVE;
+    if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result) != 0) return false;
+
+    std::memcpy(&address, result->ai_addr, result->ai_addrlen);
+    length = result->ai_addrlen;
+    freeaddrinfo(result);
+    return true;
+}
+
+static bool isSameAddress(const sockaddr_storage &a, const sockaddr_storage &b) {
+    if (a.ss_family != b.ss_family) return false;
+
+    switch (a.ss_family) {
+        case AF_UNIX: {
+            auto &x = reinterpret_cast<const sockaddr_un &>(a), &y = reinterpret_cast<const sockaddr_un &>(b);
+            return strncmp(x.sun_path, y.sun_path, sizeof(x.sun_path)) == 0;
+        }
+        case AF_INET: {
+            auto &x = reinterpret_cast<const sockaddr_in &>(a), &y = reinterpret_cast<const sockaddr_in &>(b);
+            return x.sin_port == y.sin_port && x.sin_addr.s_addr == y.sin_addr.s_addr;
+        }
+        case AF_INET6: {
+            auto &x = reinterpret_cast<const sockaddr_in6 &>(a), &y = reinterpret_cast<const sockaddr_in6 &>(b);
+            return x.sin6_port == y.sin6_port && std::memcmp(&x.sin6_addr, &y.sin6_addr, sizeof(x.sin6_addr)) == 0;
+        }
+    }
+
+    return false;
+}
+
+void Replication::initialize(const std::string &listenAddress, const std::string &peerAddress, bool standby) {
+    sockaddr_storage address;
+    socklen_t addressLength;
+    if (!resolveAddress(listenAddress, AF_UNSPEC, address, addressLength)) {
+        LOGGER_ERROR("invalid replication listen address: {}", listenAddress);
+        exit(1);
+    }
+    if (!resolveAddress(peerAddress, address.ss_family, Replication::peerAddress, peerAddressLength)) {
+        LOGGER_ERROR("invalid replication peer address, or not of the same kind as the listen address: {}", peerAddress);
+        exit(1);
+    }
+
+    ENSURE_ERRNO(fd = socket(address.ss_family, SOCK_DGRAM | SOCK_CLOEXEC, 0));
+    if (address.ss_family == AF_UNIX) {
+        unlink(reinterpret_cast<sockaddr_un *>(&address)->sun_path);
+    } else {
+        // The next process binds while this one is handing over
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
+    }
+    ENSURE_ERRNO(bind(fd, reinterpret_cast<sockaddr *>(&address), addressLength));
+
+    // Room for a snapshot arriving in bursts, up to net.core.rmem_max
+    int bufferSize = 4 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+
+    LOGGER_INFO("replicating routes on {} with peer {}", listenAddress, peerAddress);
+    std::thread(receiveLoop).detach();
+
+    Clock::schedule(CHECKSUM_INTERVAL, sendChecksum);
+
+    // The routes loaded on start are kept for the promotion
+    if (standby) {
+        LOGGER_INFO("starting as standby");
+        Replication::standby = true;
+        Metrics::replicationStandby.set(1);
+        requestResync("started");
+    }
+}
+
+void Replication::receiveLoop() {
+    // Signal handlers touch the routing table, never run them on this thread
+    sigset_t signals;
+    sigfillset(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    char buffer[sizeof(Header) + MAX_ENTRIES * sizeof(Entry)];
+    while (true) {
+        sockaddr_storage source = {};
+        socklen_t sourceLength = sizeof(source);
+        auto size = recvfrom(fd, buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr *>(&source), &sourceLength);
+        if (size < 0) continue;
+
+        if (!isSameAddress(source, peerAddress)) {
+            LOGGER_DEBUG("replication datagram not from the peer ignored");
+            continue;
+        }
+
+        auto &header = *reinterpret_cast<const Header *>(buffer);
+        if (
+            (size_t)size < sizeof(Header) ||
+            std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+            header.version != VERSION ||
+            (header.type == DELTA && (header.count > MAX_ENTRIES || (size_t)size != sizeof(Header) + header.count * sizeof(Entry)))
+        ) {
+            LOGGER_WARNING("malformed replication datagram: {}", toHex(buffer, std::min<size_t>(size, sizeof(Header))));
+            continue;
+        }
+
+        Metrics::replicationReceived.increment();
+        Sniffer::post([message = std::string(buffer, size)] { onMessage(message); });
+    }
+}
+
+void Replication::onMessage(const std::string &message) {
+    auto &header = *reinterpret_cast<const Header *>(message.data());
+
+    if (!standby) {
+        if (header.type == RESYNC) {
+            LOGGER_INFO("the standby asked for all routes");
+            sendSnapshot();
+        } else {
+            LOGGER_VERBOSE("replication datagram ignored, the peer is active too");
+        }
+        return;
+    }
+
+    if (header.type == RESYNC) return;
+
+    // A snapshot starts over anyway
+    if (header.type != SNAPSHOT && receivedSequence && header.sequence != *receivedSequence + 1) {
+        LOGGER_VERBOSE("replication datagrams {} to {} lost", *receivedSequence + 1, header.sequence - 1);
+        requestResync("datagrams lost");
+    }
+    receivedSequence = header.sequence;
+
+    if (header.type == SNAPSHOT) {
+        LOGGER_VERBOSE("receiving all routes from the peer");
+        replicatedRoutes.clear();
+        resyncRequested = false;
+    } else if (header.type == DELTA) {
+        auto entries = reinterpret_cast<const Entry *>(message.data() + sizeof(Header));
+        for (size_t i = 0; i < header.count; i++) {
+            auto address = Tins::IPv6Address(entries[i].address);
+            std::string interface(entries[i].interface, strnlen(entries[i].interface, sizeof(entries[i].interface)));
+            if (interface.empty())
+                replicatedRoutes.erase(address);
+            else
+                replicatedRoutes[address] = {interface, static_cast<time_t>(entries[i].lastSeen)};
+        }
+    } else if (header.type == CHECKSUM) {
+        uint64_t checksum = 0;
+        for (const auto &[address, route] : replicatedRoutes) checksum ^= hashRoute(address, route.interface);
+
+        // Asked again until the tables match, in case the request or the snapshot is lost
+        resyncRequested = false;
+        if (header.count != replicatedRoutes.size() || header.checksum != checksum) {
+            LOGGER_VERBOSE("replicated {} routes, the peer has {}", replicatedRoutes.size(), header.count);
+            requestResync("checksum mismatch");
+        }
+    }
+
+    Metrics::replicatedRoutes.set(replicatedRoutes.size());
+}
+
+bool Replication::send(MessageType type, const Entry *entries, size_t count, uint64_t checksum) {
+    char buffer[sizeof(Header) + MAX_ENTRIES * sizeof(Entry)];
+    auto &header = *reinterpret_cast<Header *>(buffer);
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.type = type;
+    header.sequence = sentSequence;
+    header.count = count;
+    header.reserved = 0;
+    header.checksum = checksum;
+    auto size = sizeof(Header);
+    if (type == DELTA) {
+        std::memcpy(buffer + size, entries, count * sizeof(Entry));
+        size += count * sizeof(Entry);
+    }
+
+    // Never block the main loop on the peer
+    if (sendto(fd, buffer, size, MSG_DONTWAIT, reinterpret_cast<sockaddr *>(&peerAddress), peerAddressLength) < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) return false;
+
+        // The peer is down, the sequence tells it what's lost once it's back
+        LOGGER_DEBUG("failed to send to the replication peer: {}", strerror(errno));
+        Metrics::replicationDropped.increment();
+    } else {
+        Metrics::replicationSent.increment();
+    }
+
+    sentSequence++;
+    return true;
+}
+
+void Replication::recordChange(const Tins::IPv6Address &address, const Interface *interface, time_t lastSeen) {
+    if (standby) return;
+
+    Entry entry = {};
+    std::copy(address.begin(), address.end(), entry.address);
+    if (interface) std::strncpy(entry.interface, interface->name.c_str(), sizeof(entry.interface) - 1);
+    entry.lastSeen = lastSeen;
+    pendingChanges[address] = entry;
+
+    if (!flushScheduled) {
+        flushScheduled = true;
+        Clock::schedule(FLUSH_DELAY, [] {
+            flushScheduled = false;
+            flush();
+        });
+    }
+}
+
+void Replication::flush() {
+    // Sent after the snapshot, not to be overwritten by its older entries
+    if (standby || pendingChanges.empty() || snapshotSent < snapshot.size()) return;
+
+    std::vector<Entry> entries;
+    entries.reserve(pendingChanges.size());
+    for (const auto &[_, entry] : pendingChanges) entries.push_back(entry);
+    pendingChanges.clear();
+
+    for (size_t i = 0; i < entries.size(); i += MAX_ENTRIES) {
+        if (!send(DELTA, entries.data() + i, std::min(MAX_ENTRIES, entries.size() - i))) {
+            // The sequence isn't advanced, so count it lost to make the standby resync
+            LOGGER_DEBUG("replication socket full, route changes dropped");
+            Metrics::replicationDropped.increment();
+            sentSequence++;
+        }
+    }
+}
+
+void Replication::sendChecksum() {
+    Clock::schedule(CHECKSUM_INTERVAL, sendChecksum);
+    if (standby || snapshotSent < snapshot.size()) return;
+
+    // The standby compares with the changes sent before
+    flush();
+
+    uint64_t checksum = 0;
+    size_t count = 0;
+    RouteManager::visitRoutes(0, SIZE_MAX, [&] (const RouteManager::RouteInfo &route) {
+        checksum ^= hashRoute(route.address, route.interface->name);
+        count++;
+    });
+    send(CHECKSUM, nullptr, count, checksum);
+}
+
+void Replication::sendSnapshot() {
+    // Restart a snapshot in progress, the standby cleared its table again
+    snapshot.clear();
+    snapshot.reserve(RouteManager::getRouteCount());
+    RouteManager::visitRoutes(0, SIZE_MAX, [&] (const RouteManager::RouteInfo &route) {
+        Entry entry = {};
+        std::copy(route.address.begin(), route.address.end(), entry.address);
+        std::strncpy(entry.interface, route.interface->name.c_str(), sizeof(entry.interface) - 1);
+        entry.lastSeen = route.lastSeen;
+        snapshot.push_back(entry);
+    });
+    snapshotSent = 0;
+    // Covered by the snapshot
+    pendingChanges.clear();
+
+    Metrics::replicationResyncs.increment();
+    if (!send(SNAPSHOT, nullptr, 0)) {
+        LOGGER_WARNING("replication socket full, snapshot not sent");
+        snapshot.clear();
+        return;
+    }
+    continueSnapshot(++snapshotGeneration);
+}
+
+void Replication::continueSnapshot(uint64_t generation) {
+    // Another snapshot was started, or the role changed
+    if (generation != snapshotGeneration || standby) return;
+
+    for (size_t i = 0; i < SNAPSHOT_BATCH && snapshotSent < snapshot.size(); i++) {
+        auto count = std::min(MAX_ENTRIES, snapshot.size() - snapshotSent);
+        if (!send(DELTA, snapshot.data() + snapshotSent, count)) break;
+        snapshotSent += count;
+    }
+
+    if (snapshotSent < snapshot.size()) {
+        Clock::schedule(SNAPSHOT_PAUSE, [generation] { continueSnapshot(generation); });
+        return;
+    }
+
+    LOGGER_VERBOSE("sent {} routes to the standby", snapshot.size());
+    snapshot.clear();
+    snapshotSent = 0;
+    flush();
+}
+
+void Replication::requestResync(const char *reason) {
+    if (resyncRequested) return;
+
+    LOGGER_INFO("asking the peer for all routes: {}", reason);
+    resyncRequested = true;
+    send(RESYNC, nullptr, 0);
+}
+
+uint64_t Replication::hashRoute(const Tins::IPv6Address &address, const std::string &interface) {
+    // FNV-1a, the same on both instances whatever the standard library
+    uint64_t hash = 0xcbf29ce484222325;
+    auto add = [&] (uint8_t byte) {
+        hash ^= byte;
+        hash *= 0x100000001b3;
+    };
+    for (auto byte : address) add(byte);
+    for (auto ch : interface) add(ch);
+    return hash;
+}
+
+void Replication::keepRoutes(const std::vector<RouteSnapshot::Route> &routes) {
+    for (const auto &route : routes)
+        replicatedRoutes[route.address] = {route.interface->name, route.lastSeen};
+    Metrics::replicatedRoutes.set(replicatedRoutes.size());
+    LOGGER_INFO("keeping {} saved routes until promoted", routes.size());
+}
+
+std::optional<std::string> Replication::promote() {
+    if (!standby) return "not standby";
+
+    std::vector<RouteSnapshot::Route> routes;
+    routes.reserve(replicatedRoutes.size());
+    for (const auto &[address, route] : replicatedRoutes) {
+        auto it = Interface::interfaces.find(route.interface);
+        if (it == Interface::interfaces.end()) {
+            LOGGER_VERBOSE("replicated route {} on unknown interface [{}] dropped", address, route.interface);
+            continue;
+        }
+        routes.push_back({address, it->second, route.lastSeen});
+    }
+
+    LOGGER_INFO("promoted to active, installing {} replicated routes", routes.size());
+    standby = false;
+    Metrics::replicationStandby.set(0);
+    replicatedRoutes.clear();
+    receivedSequence.reset();
+    resyncRequested = false;
+    Metrics::replicatedRoutes.set(0);
+
+    RouteManager::installRoutes(routes);
+    Sniffer::startCaptures();
+
+    // The peer may be standby now, or once back
+    sendSnapshot();
+    return std::nullopt;
+}
+
+std::optional<std::string> Replication::demote() {
+    if (standby) return "already standby";
+
+    LOGGER_INFO("demoted to standby");
+    standby = true;
+    Metrics::replicationStandby.set(1);
+    snapshot.clear();
+    snapshotSent = 0;
+    pendingChanges.clear();
+
+    Sniffer::stopCaptures();
+    for (const auto &route : RouteManager::releaseRoutes())
+        replicatedRoutes[route.address] = {route.interface->name, route.lastSeen};
+    Metrics::replicatedRoutes.set(replicatedRoutes.size());
+
+    requestResync("demoted");
+    return std::nullopt;
+}
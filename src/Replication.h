@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <optional>
+#include <unordered_map>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <tins/tins.h>
+
+#include "Interface.h"
+#include "RouteSnapshot.h"
+
+// Replicates the routes of the active instance to a standby one, over UDP or a Unix datagram
+// socket, so the standby takes over with the routes installed when promoted. Each datagram is:
+//
+//   Header
+//   Entry[count]                              (DELTA only)
+//
+// The active instance sends the route changes as DELTA, batched for a moment, and a CHECKSUM of
+// the whole table periodically. The standby keeps the routes without installing them, and asks
+// for a RESYNC on a lost datagram or a checksum mismatch. The active one then sends a SNAPSHOT,
+// which clears the table of the standby, followed by all the routes as DELTA. Interfaces are
+// matched by name. The standby doesn't capture, and only datagrams from the peer are accepted.
+class Replication {
+public:
+    static constexpr char MAGIC[8] = {'M', 'A', 'G', 'P', 'I', 'E', 'R', 'P'};
+    static constexpr uint32_t VERSION = 1;
+
+    enum MessageType : uint32_t {
+        DELTA = 1,
+        CHECKSUM = 2,
+        RESYNC = 3,
+        SNAPSHOT = 4
+    };
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t type;
+        // Of each datagram sent, to find the lost ones
+        uint64_t sequence;
+        // The entries following, or the routes in the table for CHECKSUM
+        uint32_t count;
+        uint32_t reserved;
+        uint64_t checksum;
+    };
+
+    struct Entry {
+        uint8_t address[Tins::IPv6Address::address_size];
+        // Empty if the route is deleted
+        char interface[IFNAMSIZ];
+        int64_t lastSeen;
+        uint64_t reserved;
+    };
+
+    static_assert(sizeof(Header) == 40);
+    static_assert(sizeof(Entry) == 48);
+
+    // Within an Ethernet MTU over IPv6 and UDP
+    static constexpr size_t MAX_ENTRIES = 28;
+
+private:
+    struct ReplicatedRoute {
+        std::string interface;
+        time_t lastSeen;
+    };
+
+    inline static int fd = -1;
+    inline static sockaddr_storage peerAddress;
+    inline static socklen_t peerAddressLength = 0;
+    inline static bool standby = false;
+
+    // Active: the changes not sent yet, and the snapshot being sent
+    inline static std::unordered_map<Tins::IPv6Address, Entry> pendingChanges;
+    inline static bool flushScheduled = false;
+    inline static std::vector<Entry> snapshot;
+    inline static size_t snapshotSent = 0;
+    inline static uint64_t snapshotGeneration = 0;
+    inline static uint64_t sentSequence = 0;
+
+    // Standby: the routes of the active instance
+    inline static std::unordered_map<Tins::IPv6Address, ReplicatedRoute> replicatedRoutes;
+    inline static std::optional<uint64_t> receivedSequence;
+    inline static bool resyncRequested = false;
+
+    static void receiveLoop();
+    // On the main loop
+    static void onMessage(const std::string &message);
+    // Returns false if the socket is full
+    static bool send(MessageType type, const Entry *entries, size_t count, uint64_t checksum = 0);
+    static void flush();
+    static void sendChecksum();
+    static void sendSnapshot();
+    static void continueSnapshot(uint64_t generation);
+    static void requestResync(const char *reason);
+    static uint64_t hashRoute(const Tins::IPv6Address &address, const std::string &interface);
+
+public:
+    // Listen on "host:port" or "unix:/path", and replicate to or from the peer on the same kind of address
+    static void initialize(const std::string &listenAddress, const std::string &peerAddress, bool standby);
+    static bool isEnabled() {
+        return fd >= 0;
+    }
+    static bool isStandby() {
+        return standby;
+    }
+
+    // Standby: keep the saved routes loaded on start, until replaced by the peer's
+    static void keepRoutes(const std::vector<RouteSnapshot::Route> &routes);
+    // A route is added, refreshed or deleted (interface null), sent to the standby shortly
+    static void recordChange(const Tins::IPv6Address &address, const Interface *interface, time_t lastSeen);
+
+    // Install the replicated routes and start capturing. Returns the error if not standby
+    static std::optional<std::string> promote();
+    // Stop capturing and keep the routes replicated from the peer instead. Returns the error if standby
+    static std::optional<std::string> demote();
+};
@@ -1,6 +1,8 @@
 #include "RequestManager.h"
 
 #include "Logger.h"
+#include "Metrics.h"
+#include "Clock.h"
 #include <utility>
 
 std::unordered_multimap<Tins::IPv6Address, std::shared_ptr<RequestManager::NDPRequest>> RequestManager::requests;
@@ -9,13 +11,14 @@ std::multimap<time_t, std::shared_ptr<RequestManager::NDPRequest>> RequestManage
 void RequestManager::checkExpiration() {
     constexpr size_t REQUEST_EXPIRATION_TIME = 10;
 
-    auto now = std::time(nullptr);
+    auto now = Clock::now();
     for (auto it = requestExperiation.begin(), next = it; it != requestExperiation.end(); it = next) {
         next = std::next(it);
 
         auto request = it->second;
         if (now - request->requestTime >= REQUEST_EXPIRATION_TIME) {
-            Logger::verbose("deleting expired request for {} from [{}] {}", request->targetAddress, request->fromInterface->name, request->sourceAddress);
+            LOGGER_VERBOSE("deleting expired request for {} from [{}] {}", request->targetAddress, request->fromInterface->name, request->sourceAddress);
+            Metrics::requestsExpired.increment();
             deleteRequest(request);
         } else
             break;
@@ -25,6 +28,7 @@ void RequestManager::checkExpiration() {
 void RequestManager::deleteRequest(std::shared_ptr<NDPRequest> request) {
     requests.erase(request->itR);
     requestExperiation.erase(request->itE);
+    Metrics::pendingRequests.set(requests.size());
 }
 
 void RequestManager::addRequest(
@@ -47,7 +51,7 @@ void RequestManager::addRequest(
         }
     }
 
-    auto now = std::time(nullptr);
+    auto now = Clock::now();
     auto request = std::make_shared<NDPRequest>();
     request->sourceMacAddress = sourceMacAddress;
     request->sourceAddress = sourceAddress;
@@ -56,10 +60,34 @@ void RequestManager::addRequest(
     request->requestTime = now;
     request->itR = requests.insert(std::make_pair(targetAddress, request));
     request->itE = requestExperiation.insert(std::make_pair(now, request));
+    Metrics::requestsAdded.increment();
+    Metrics::pendingRequests.set(requests.size());
 
     checkExpiration();
 }
 
+size_t RequestManager::getRequestCount() {
+    return requests.size();
+}
+
+void RequestManager::visitRequests(const std::function<void (const RequestInfo &)> &callback) {
+    for (const auto &[_, request] : requestExperiation) {
+        callback({request->sourceMacAddress, request->sourceAddress, request->targetAddress, request->fromInterface, request->requestTime});
+    }
+}
+
+void RequestManager::adoptRequest(const RequestInfo &info) {
+    auto request = std::make_shared<NDPRequest>();
+    request->sourceMacAddress = info.sourceMacAddress;
+    request->sourceAddress = info.sourceAddress;
+    request->targetAddress = info.targetAddress;
+    request->fromInterface = info.fromInterface;
+    request->requestTime = info.requestTime;
+    request->itR = requests.insert(std::make_pair(info.targetAddress, request));
+    request->itE = requestExperiation.insert(std::make_pair(info.requestTime, request));
+    Metrics::pendingRequests.set(requests.size());
+}
+
 void RequestManager::matchAndRespond(
     const Tins::IPv6Address &targetAddress,
     std::function<void (
@@ -74,6 +102,7 @@ void RequestManager::matchAndRespond(
 
         auto request = it->second;
         sendPacket(request->sourceMacAddress, request->sourceAddress, request->fromInterface);
+        Metrics::requestsAnswered.increment();
         deleteRequest(request);
     }
 
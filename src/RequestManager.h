@@ -3,12 +3,23 @@
 #include <ctime>
 #include <memory>
 #include <map>
+#include <functional>
 #include <unordered_map>
 #include <tins/tins.h>
 
 #include "Interface.h"
 
 class RequestManager {
+public:
+    struct RequestInfo {
+        Tins::HWAddress<6> sourceMacAddress;
+        Tins::IPv6Address sourceAddress;
+        Tins::IPv6Address targetAddress;
+        std::shared_ptr<Interface> fromInterface;
+        time_t requestTime;
+    };
+
+private:
     struct NDPRequest {
         Tins::HWAddress<6> sourceMacAddress;
         Tins::IPv6Address sourceAddress;
@@ -33,6 +44,10 @@ public:
         const Tins::IPv6Address &targetAddress,
         std::shared_ptr<Interface> fromInterface
     );
+    static size_t getRequestCount();
+    static void visitRequests(const std::function<void (const RequestInfo &)> &callback);
+    // Add a request handed over by the previous process, keeping its time
+    static void adoptRequest(const RequestInfo &info);
     static void matchAndRespond(
         const Tins::IPv6Address &targetAddress,
         std::function<void (
@@ -1,48 +1,71 @@
 #include "RouteManager.h"
 
-#include <fstream>
 #include <memory>
 #include <vector>
+#include <cstdio>
+#include <algorithm>
+#include <chrono>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <fmt/format.h>
-#include <cereal/archives/json.hpp>
-#include <cereal/types/vector.hpp>
 
 #include "Ensure/Ensure.h"
 #include "Logger.h"
 #include "Interface.h"
+#include "RouteSnapshotWriter.h"
+#include "Metrics.h"
+#include "Replication.h"
+#include "Clock.h"
 
 size_t RouteManager::checkInterval;
 size_t RouteManager::probeInterval;
 size_t RouteManager::probeRetries;
 std::string RouteManager::routesSaveFile;
+RouteSnapshot::Format RouteManager::routesSaveFormat;
+size_t RouteManager::routesSaveInterval;
+time_t RouteManager::lastRoutesSave;
+std::unordered_map<Tins::IPv6Address, RouteSnapshot::Route> RouteManager::changedRoutes;
+bool RouteManager::warmStart;
+size_t RouteManager::warmStartProbeRate;
 std::function<void (Tins::IPv6Address, std::shared_ptr<Interface>)> RouteManager::probeCallback;
+std::unique_ptr<RouteProgrammer> RouteManager::routeProgrammer = std::make_unique<IpCommandRouteProgrammer>();
 
 std::unordered_map<Tins::IPv6Address, std::shared_ptr<RouteManager::RouteItem>> RouteManager::routes;
 std::multimap<time_t, std::shared_ptr<RouteManager::RouteItem>> RouteManager::routeExpiration;
+std::deque<std::shared_ptr<RouteManager::RouteItem>> RouteManager::provisionalRoutes;
 
 void RouteManager::initialize(
     size_t checkInterval,
     size_t probeInterval,
     size_t probeRetries,
     const std::string &routesSaveFile,
+    RouteSnapshot::Format routesSaveFormat,
+    size_t routesSaveInterval,
+    bool warmStart,
+    size_t warmStartProbeRate,
     std::function<void (Tins::IPv6Address, std::shared_ptr<Interface>)> probeCallback
 ) {
     RouteManager::checkInterval = checkInterval;
     RouteManager::probeInterval = probeInterval;
     RouteManager::probeRetries = probeRetries;
     RouteManager::routesSaveFile = routesSaveFile;
+    RouteManager::routesSaveFormat = routesSaveFormat;
+    RouteManager::routesSaveInterval = routesSaveFile.empty() ? 0 : routesSaveInterval;
+    RouteManager::warmStart = warmStart;
+    RouteManager::warmStartProbeRate = warmStartProbeRate;
     RouteManager::probeCallback = probeCallback;
 
-    // Set POSIX timer
-    ENSURE_ERRNO(signal(SIGALRM, processTimerTick));
+    // Routes adopted from the previous process were scheduled before the intervals were known
+    for (const auto &[_, route] : routes) route->interval = probeInterval;
+    rescheduleProbes();
+
+    // Check routes on the main loop, no timer if the interval is 0
     setTimer();
 
     if (routesSaveFile.empty()) {
-        Logger::warning("no route save file specfied, restarting will lose route info and cause network delay on next start");
+        LOGGER_WARNING("no route save file specfied, restarting will lose route info and cause network delay on next start");
     } else {
         // Ensure file read & writable
         int fd;
@@ -56,39 +79,79 @@ void RouteManager::initialize(
         // Close file
         close(fd);
 
-        if (fileSize > 0) loadRoutes();
+        if (!routes.empty()) {
+            // Handed over by the previous process, newer than the file. Let the snapshot writer mirror them
+            for (const auto &[_, route] : routes) recordChange(*route, false);
+        } else if (fileSize > 0) {
+            loadRoutes();
+        }
+
+        if (RouteManager::routesSaveInterval != 0) {
+            RouteSnapshotWriter::initialize(routesSaveFile, routesSaveFormat);
+            lastRoutesSave = Clock::now();
+        }
     }
 
     ENSURE_ERRNO(std::atexit(RouteManager::onExit));
 }
 
-void RouteManager::addOrRefreshRoute(const Tins::IPv6Address &address, std::shared_ptr<Interface> interface) {
+bool RouteManager::addOrRefreshRoute(const Tins::IPv6Address &address, std::shared_ptr<Interface> interface, const std::optional<Tins::HWAddress<6>> &macAddress) {
     // Find old one
+    bool moved = false;
     if (auto itR = routes.find(address); itR != routes.end()) {
         auto oldRoute = itR->second;
-        if (oldRoute->interface != interface) {
+        if (oldRoute->pinned && oldRoute->interface != interface) {
+            LOGGER_VERBOSE("host {} seen on [{}], but pinned to [{}]", address, interface->name, oldRoute->interface->name);
+            return false;
+        } else if (oldRoute->interface != interface) {
             // Replace -- delete old first
-            Logger::warning("host {} moved from interface [{}] to [{}]", address, oldRoute->interface->name, interface->name);
+            LOGGER_WARNING("host {} moved from interface [{}] to [{}]", address, oldRoute->interface->name, interface->name);
+            Metrics::routesMoved.increment();
             deleteRoute(oldRoute);
+            moved = true;
         } else if (oldRoute->interface == interface) {
             // Refresh
-            oldRoute->lastProbe = std::time(nullptr);
+            if (oldRoute->probeRetries != 0) Metrics::probesConfirmed.increment();
+            if (oldRoute->provisional) {
+                LOGGER_VERBOSE("provisional route {} dev {} confirmed", address, interface->name);
+                Metrics::provisionalRoutes.add(-1);
+            }
+            // Back off from a host answering the first probe, probe one needing retries sooner
+            if (oldRoute->probeRetries == 1) oldRoute->interval = clampInterval(oldRoute->interval * 2);
+            else if (oldRoute->probeRetries > 1) oldRoute->interval = clampInterval(oldRoute->interval / 2);
+            oldRoute->lastProbe = oldRoute->lastSeen = Clock::now();
             oldRoute->probeRetries = 0;
-            routeExpiration.erase(oldRoute->itE);
-            oldRoute->itE = routeExpiration.insert(std::make_pair(oldRoute->lastProbe, oldRoute));
-            return;
+            oldRoute->provisional = false;
+            unscheduleProbe(*oldRoute);
+            scheduleProbe(oldRoute);
+            recordChange(*oldRoute, false);
+            if (macAddress && macVerifyInterval != 0) setHost(oldRoute, *macAddress);
+            if (oldRoute->host) confirmHost(*oldRoute, oldRoute->lastSeen);
+            return false;
         }
     }
 
     auto route = std::make_shared<RouteItem>();
     route->address = address;
     route->interface = interface;
-    route->lastProbe = std::time(nullptr);
+    route->lastProbe = route->lastSeen = Clock::now();
     route->probeRetries = 0;
+    // A host just moved may move again soon
+    route->interval = clampInterval(moved ? 0 : probeInterval);
+    route->provisional = false;
+    route->pinned = false;
     route->itR = routes.insert(std::make_pair(address, route)).first;
-    route->itE = routeExpiration.insert(std::make_pair(route->lastProbe, route));
+    scheduleProbe(route);
+    recordChange(*route, false);
+    Metrics::routesAdded.increment();
+    Metrics::routes.set(routes.size());
+    if (macAddress && macVerifyInterval != 0) {
+        setHost(route, *macAddress);
+        confirmHost(*route, route->lastSeen);
+    }
 
     updateRouteTable(route, true);
+    return true;
 }
 
 std::shared_ptr<Interface> RouteManager::getRoute(const Tins::IPv6Address &address) {
@@ -97,130 +160,564 @@ std::shared_ptr<Interface> RouteManager::getRoute(const Tins::IPv6Address &addre
     return nullptr;
 }
 
+RouteManager::RouteInfo RouteManager::toRouteInfo(const RouteItem &item) {
+    return {item.address, item.interface, item.lastProbe, item.lastSeen, item.probeRetries, item.provisional, item.pinned, item.interval};
+}
+
+std::optional<RouteManager::RouteInfo> RouteManager::lookupRoute(const Tins::IPv6Address &address) {
+    auto it = routes.find(address);
+    if (it == routes.end()) return std::nullopt;
+    return toRouteInfo(*it->second);
+}
+
+size_t RouteManager::visitRoutes(size_t cursor, size_t limit, const std::function<void (const RouteInfo &)> &callback) {
+    size_t visited = 0;
+    for (; cursor < routes.bucket_count() && visited < limit; cursor++) {
+        for (auto it = routes.begin(cursor); it != routes.end(cursor); it++, visited++)
+            callback(toRouteInfo(*it->second));
+    }
+
+    return cursor < routes.bucket_count() ? cursor : 0;
+}
+
+bool RouteManager::reprobeRoute(const Tins::IPv6Address &address) {
+    auto it = routes.find(address);
+    if (it == routes.end()) return false;
+
+    LOGGER_INFO("re-probing route {} dev {} on request", address, it->second->interface->name);
+    Metrics::probesSent.increment();
+    probeCallback(address, it->second->interface);
+    return true;
+}
+
+bool RouteManager::pinRoute(const Tins::IPv6Address &address, std::shared_ptr<Interface> interface) {
+    if (auto it = routes.find(address); it != routes.end()) {
+        auto route = it->second;
+        if (!interface || route->interface == interface) {
+            LOGGER_INFO("pinning route {} dev {}", address, route->interface->name);
+            if (route->provisional) Metrics::provisionalRoutes.add(-1);
+            route->pinned = true;
+            route->provisional = false;
+            unscheduleProbe(*route);
+            scheduleProbe(route);
+            return true;
+        }
+
+        deleteRoute(route);
+    } else if (!interface) {
+        return false;
+    }
+
+    LOGGER_INFO("pinning route {} dev {}", address, interface->name);
+    addOrRefreshRoute(address, interface);
+    routes[address]->pinned = true;
+    return true;
+}
+
+bool RouteManager::unpinRoute(const Tins::IPv6Address &address) {
+    auto it = routes.find(address);
+    if (it == routes.end() || !it->second->pinned) return false;
+
+    LOGGER_INFO("unpinning route {} dev {}", address, it->second->interface->name);
+    it->second->pinned = false;
+    return true;
+}
+
+bool RouteManager::removeRoute(const Tins::IPv6Address &address) {
+    auto it = routes.find(address);
+    if (it == routes.end()) return false;
+
+    LOGGER_INFO("deleting route {} dev {} on request", address, it->second->interface->name);
+    deleteRoute(it->second);
+    return true;
+}
+
+size_t RouteManager::getRouteCount() {
+    return routes.size();
+}
+
 void RouteManager::deleteRoute(std::shared_ptr<RouteItem> item) {
     updateRouteTable(item, false);
     routes.erase(item->itR);
-    routeExpiration.erase(item->itE);
+    unscheduleProbe(*item);
+    unsetHost(*item);
+    recordChange(*item, true);
+    Metrics::routes.set(routes.size());
+    if (item->provisional) Metrics::provisionalRoutes.add(-1);
+}
+
+void RouteManager::setHost(std::shared_ptr<RouteItem> item, const Tins::HWAddress<6> &macAddress) {
+    auto key = std::make_pair(static_cast<const Interface *>(item->interface.get()), macAddress);
+    if (item->host && item->host->itH->first == key) return;
+
+    unsetHost(*item);
+    auto &host = hosts[key];
+    if (!host) {
+        host = std::make_shared<HostItem>();
+        host->lastSeen = host->lastProbe = item->lastSeen;
+        host->probeRetries = 0;
+        host->itH = hosts.find(key);
+        Metrics::hosts.set(hosts.size());
+    }
+    item->host = host;
+    item->itH = host->routes.insert(host->routes.end(), item);
+}
+
+void RouteManager::unsetHost(RouteItem &item) {
+    if (!item.host) return;
+
+    auto host = std::move(item.host);
+    host->routes.erase(item.itH);
+    if (host->routes.empty()) {
+        hosts.erase(host->itH);
+        Metrics::hosts.set(hosts.size());
+    }
+}
+
+void RouteManager::confirmHost(const RouteItem &item, time_t now) {
+    auto &host = *item.host;
+    host.lastSeen = now;
+    host.probeRetries = 0;
+
+    for (const auto &route : host.routes) {
+        // Addresses due to be verified themselves, or not confirmed once yet, aren't extended
+        if (route.get() == &item || route->pinned || route->provisional || now - route->lastSeen >= (time_t)macVerifyInterval) continue;
+
+        route->lastProbe = now;
+        route->probeRetries = 0;
+        unscheduleProbe(*route);
+        scheduleProbe(route);
+    }
+}
+
+bool RouteManager::isCoveredByHost(const RouteItem &item, time_t now) {
+    if (!item.host || macVerifyInterval == 0 || now - item.lastSeen >= (time_t)macVerifyInterval) return false;
+
+    // Another address was confirmed lately, or was just probed for the host, and the host answered the
+    // probe before. Once the host stops answering, each address is probed itself again
+    auto &host = *item.host;
+    return now - host.lastSeen < (time_t)probeInterval || (host.lastProbe == now && host.probeRetries <= 1);
+}
+
+void RouteManager::groupByMacAddress(size_t verifyInterval) {
+    macVerifyInterval = verifyInterval;
+    if (verifyInterval != 0) return;
+
+    // Ungroup all, the routes are probed on their own from now on
+    for (const auto &[_, route] : routes) route->host = nullptr;
+    hosts.clear();
+    Metrics::hosts.set(0);
 }
 
 void RouteManager::updateRouteTable(std::shared_ptr<RouteItem> item, bool isAdd) {
-    auto command = fmt::format("ip -6 route {} {} dev {}", (isAdd ? "add" : "del"), item->address, item->interface->name);
-    Logger::info("executing '{}'", command);
-    if (system(command.c_str()) != 0) {
-        Logger::error("command failed!");
+    auto startTime = std::chrono::steady_clock::now();
+    routeProgrammer->update(item->address, *item->interface, isAdd);
+    Metrics::routeInstallLatency.record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count());
+}
+
+void RouteManager::updateRouteTableBatch(const std::vector<std::shared_ptr<RouteItem>> &items, bool isAdd) {
+    std::vector<RouteProgrammer::Route> routes;
+    routes.reserve(items.size());
+    for (const auto &item : items) routes.emplace_back(item->address, item->interface);
+    routeProgrammer->updateBatch(routes, isAdd);
+}
+
+void RouteManager::setRouteProgrammer(std::unique_ptr<RouteProgrammer> routeProgrammer) {
+    RouteManager::routeProgrammer = std::move(routeProgrammer);
+}
+
+void RouteManager::suspendInterface(std::shared_ptr<Interface> interface) {
+    std::vector<RouteProgrammer::Route> items;
+    for (const auto &[_, route] : routes)
+        if (route->interface == interface) items.emplace_back(route->address, route->interface);
+    routeProgrammer->suspendRoutes(items);
+}
+
+void RouteManager::resumeInterface(std::shared_ptr<Interface> interface) {
+    // The kernel deleted the routes if the interface was removed, and their hosts get a full
+    // round of probes before expiring
+    auto now = Clock::now();
+    std::vector<std::shared_ptr<RouteItem>> items;
+    for (const auto &[_, route] : routes) {
+        if (route->interface != interface) continue;
+
+        route->lastProbe = now;
+        route->probeRetries = 0;
+        unscheduleProbe(*route);
+        scheduleProbe(route);
+        items.push_back(route);
+    }
+
+    LOGGER_INFO("reinstalling {} routes on interface {}", items.size(), interface->name);
+    updateRouteTableBatch(items, true);
+    routeProgrammer->addInterface(*interface, getRoutesExcept(*interface));
+}
+
+void RouteManager::addInterface(std::shared_ptr<Interface> interface) {
+    routeProgrammer->addInterface(*interface, getRoutesExcept(*interface));
+}
+
+std::vector<RouteProgrammer::Route> RouteManager::getRoutesExcept(const Interface &interface) {
+    // Without the suspended ones, resumed later
+    std::vector<RouteProgrammer::Route> result;
+    for (const auto &[_, route] : routes)
+        if (route->interface.get() != &interface && route->interface->up) result.emplace_back(route->address, route->interface);
+    return result;
+}
+
+void RouteManager::removeInterface(std::shared_ptr<Interface> interface) {
+    std::vector<std::shared_ptr<RouteItem>> items;
+    for (const auto &[_, route] : routes)
+        if (route->interface == interface) items.push_back(route);
+
+    LOGGER_INFO("deleting {} routes on removed interface {}", items.size(), interface->name);
+    updateRouteTableBatch(items, false);
+    for (const auto &item : items) {
+        routes.erase(item->itR);
+        unscheduleProbe(*item);
+        unsetHost(*item);
+        recordChange(*item, true);
+        if (item->provisional) Metrics::provisionalRoutes.add(-1);
+    }
+    Metrics::routes.set(routes.size());
+
+    routeProgrammer->removeInterface(*interface, getRoutesExcept(*interface));
+}
+
+void RouteManager::reconfigure(size_t checkInterval, size_t probeInterval, size_t probeRetries) {
+    RouteManager::probeRetries = probeRetries;
+    if (probeInterval != RouteManager::probeInterval) {
+        RouteManager::probeInterval = probeInterval;
+        rescheduleProbes();
     }
+
+    if (checkInterval != RouteManager::checkInterval) {
+        RouteManager::checkInterval = checkInterval;
+        timerGeneration++;
+        setTimer();
+    }
+}
+
+void RouteManager::adaptProbeInterval(size_t minInterval, size_t maxInterval) {
+    if (minInterval == minProbeInterval && maxInterval == maxProbeInterval) return;
+
+    minProbeInterval = minInterval;
+    maxProbeInterval = maxInterval;
+    rescheduleProbes();
 }
 
-void RouteManager::printManagedRoutes() {
-    for (const auto [_, route] : routeExpiration) {
-        std::string formattedTime = std::ctime(&route->lastProbe);
-        formattedTime[formattedTime.length() - 1] = '0'; // Remove tailing '\n'
+size_t RouteManager::clampInterval(size_t interval) {
+    auto minInterval = minProbeInterval == 0 ? probeInterval : std::min(minProbeInterval, probeInterval);
+    auto maxInterval = std::max(maxProbeInterval, probeInterval);
+    return std::clamp(interval, minInterval, maxInterval);
+}
+
+time_t RouteManager::getProbeDue(const RouteItem &item) {
+    return item.lastProbe + (time_t)(item.probeRetries == 0 ? item.interval : std::min(item.interval, probeInterval));
+}
 
-        Logger::debug("route {} dev {} [last probe = {}, retries = {}]", route->address, route->interface->name, formattedTime, route->probeRetries);
+void RouteManager::rescheduleProbes() {
+    routeExpiration.clear();
+    for (const auto &[_, route] : routes) {
+        route->interval = clampInterval(route->interval);
+        scheduleProbe(route);
     }
 }
 
+void RouteManager::scheduleProbe(const std::shared_ptr<RouteItem> &item) {
+    item->itE = item->provisional ? routeExpiration.end() : routeExpiration.insert(std::make_pair(getProbeDue(*item), item));
+}
+
+void RouteManager::unscheduleProbe(RouteItem &item) {
+    if (item.itE != routeExpiration.end()) routeExpiration.erase(item.itE);
+    item.itE = routeExpiration.end();
+}
+
 void RouteManager::setTimer() {
-    ENSURE_ERRNO(alarm(checkInterval));
+    // A timer scheduled before the interval was changed is ignored
+    if (checkInterval != 0)
+        Clock::schedule(checkInterval, [generation = timerGeneration] {
+            if (generation == timerGeneration) processTimerTick();
+        });
 }
 
-void RouteManager::processTimerTick(int) {
-    if (Logger::showLevel >= Logger::DEBUG) printManagedRoutes();
+void RouteManager::processTimerTick() {
+    auto now = Clock::now();
+    verifyProvisionalRoutes(now);
 
-    auto now = std::time(nullptr);
     for (auto it = routeExpiration.begin(), next = it; it != routeExpiration.end(); it = next) {
         next = std::next(it);
 
         auto route = it->second;
-        if (now - route->lastProbe >= probeInterval) {
-            if (++route->probeRetries > probeRetries) {
+        if (it->first <= now) {
+            if (route->pinned || !route->interface->up) {
+                // Pinned routes, and routes on a down interface, stay without probing
+                routeExpiration.erase(route->itE);
+                route->lastProbe = now;
+                route->itE = routeExpiration.insert(std::make_pair(getProbeDue(*route), route));
+            } else if (isCoveredByHost(*route, now)) {
+                routeExpiration.erase(route->itE);
+                route->lastProbe = now;
+                route->probeRetries = 0;
+                route->itE = routeExpiration.insert(std::make_pair(getProbeDue(*route), route));
+                Metrics::probesCoalesced.increment();
+            } else if (++route->probeRetries > probeRetries) {
                 // Max probe retries reached
-                Logger::info("deleting expired route {} dev {}", route->address, route->interface->name);
+                LOGGER_INFO("deleting expired route {} dev {}", route->address, route->interface->name);
+                Metrics::routesExpired.increment();
                 deleteRoute(route);
             } else {
                 // Retry probe
                 routeExpiration.erase(route->itE);
                 route->lastProbe = now;
-                route->itE = routeExpiration.insert(std::make_pair(route->lastProbe, route));
-                Logger::verbose("re-probing route {} dev {}, retry = {}", route->address, route->interface->name, route->probeRetries);
+                route->itE = routeExpiration.insert(std::make_pair(getProbeDue(*route), route));
+                LOGGER_VERBOSE("re-probing route {} dev {}, retry = {}", route->address, route->interface->name, route->probeRetries);
+                Metrics::probesSent.increment();
+                if (route->probeRetries == 1) Metrics::probeIntervals.record((uint64_t)route->interval * 1000000);
                 probeCallback(route->address, route->interface);
+                // Probed for the host, the other addresses due now wait for the answer
+                if (route->host && now - route->lastSeen < (time_t)macVerifyInterval) {
+                    route->host->lastProbe = now;
+                    route->host->probeRetries++;
+                }
             }
         } else
             break;
     }
 
+    // Hand the changes over to the background snapshot writer, only swapping the changed set here
+    if (routesSaveInterval != 0 && now - lastRoutesSave >= (time_t)routesSaveInterval) {
+        lastRoutesSave = now;
+        if (!changedRoutes.empty()) {
+            RouteSnapshotWriter::submit(std::move(changedRoutes));
+            changedRoutes.clear();
+        }
+    }
+
     setTimer();
 }
 
+void RouteManager::adoptRoutes(const std::vector<RouteInfo> &adoptedRoutes) {
+    for (const auto &info : adoptedRoutes) {
+        if (routes.count(info.address) != 0) continue;
+
+        auto route = std::make_shared<RouteItem>();
+        route->address = info.address;
+        route->interface = info.interface;
+        route->lastProbe = info.lastProbe;
+        route->lastSeen = info.lastSeen;
+        route->probeRetries = info.probeRetries;
+        route->interval = clampInterval(probeInterval);
+        route->provisional = info.provisional;
+        route->pinned = info.pinned;
+        route->itR = routes.insert(std::make_pair(route->address, route)).first;
+        scheduleProbe(route);
+        if (route->provisional) {
+            provisionalRoutes.push_back(route);
+            Metrics::provisionalRoutes.add(1);
+        }
+    }
+    Metrics::routes.set(routes.size());
+
+    LOGGER_INFO("adopted {} routes from the previous process", adoptedRoutes.size());
+}
+
+void RouteManager::installRoutes(const std::vector<RouteSnapshot::Route> &routes) {
+    installProvisionalRoutes(routes);
+}
+
+std::vector<RouteSnapshot::Route> RouteManager::releaseRoutes() {
+    std::vector<RouteSnapshot::Route> released;
+    std::vector<std::shared_ptr<RouteItem>> items;
+    released.reserve(routes.size());
+    items.reserve(routes.size());
+    for (const auto &[_, route] : routes) {
+        released.push_back({route->address, route->interface, route->lastSeen});
+        items.push_back(route);
+        route->host = nullptr;
+    }
+
+    LOGGER_INFO("deleting {} routes from the system routing table", items.size());
+    updateRouteTableBatch(items, false);
+
+    // Not recorded as changes, the peer owns them now
+    routes.clear();
+    routeExpiration.clear();
+    provisionalRoutes.clear();
+    hosts.clear();
+    Metrics::routes.set(0);
+    Metrics::provisionalRoutes.set(0);
+    Metrics::hosts.set(0);
+    return released;
+}
+
+void RouteManager::keepRoutesOnExit() {
+    handedOver = true;
+}
+
 void RouteManager::onExit() {
+    if (handedOver) {
+        LOGGER_INFO("keeping {} routes for the new process", routes.size());
+        Logger::flush();
+        _exit(0);
+    }
+
     saveRoutes();
 
     // Delete routes on system routing table
-    for (const auto [_, route] : routeExpiration) {
-        updateRouteTable(route, false);
-    }
+    std::vector<std::shared_ptr<RouteItem>> items;
+    items.reserve(routes.size());
+    for (const auto &[_, route] : routes) items.push_back(route);
+    updateRouteTableBatch(items, false);
+
+    // _exit() skips the atexit() handler of the logger
+    Logger::flush();
 
     // The process won't exit without this line
     _exit(0);
 }
 
-struct SerializedRoute {
-    Tins::IPv6Address address;
-    std::shared_ptr<Interface> interface;
+void RouteManager::recordChange(const RouteItem &item, bool isDelete) {
+    if (Replication::isEnabled()) Replication::recordChange(item.address, isDelete ? nullptr : item.interface.get(), item.lastSeen);
+    if (routesSaveInterval == 0) return;
+
+    changedRoutes[item.address] = {item.address, isDelete ? nullptr : item.interface, item.lastSeen};
+}
+
+void RouteManager::saveRoutes() {
+    if (routesSaveFile.empty()) return;
 
-    template <class Archive>
-    void save(Archive &archive) const {
-        archive(address.to_string(), interface->name);
+    if (routesSaveInterval != 0) {
+        // Let the snapshot writer finish with the remaining changes
+        LOGGER_INFO("saving remaining route changes to file");
+        RouteSnapshotWriter::submit(std::move(changedRoutes));
+        changedRoutes.clear();
+        RouteSnapshotWriter::flush();
+        return;
     }
 
-    template <class Archive>
-    void load(Archive &archive) {
-        std::string address, interfaceName;
-        archive(address, interfaceName);
-        
-        this->address = address;
+    LOGGER_INFO("saving current routes to file");
 
-        auto it = Interface::interfaces.find(interfaceName);
-        if (it != Interface::interfaces.end()) {
-            this->interface = it->second;
-        } else {
-            Logger::warning("found previous route on unknown interface [{}]: {}", interfaceName, address);
-        }
+    std::vector<RouteSnapshot::Route> savedRoutes;
+    savedRoutes.reserve(routes.size());
+    for (const auto &[_, route] : routes) {
+        savedRoutes.push_back({route->address, route->interface, route->lastSeen});
     }
-};
 
-void RouteManager::saveRoutes() {
+    RouteSnapshot::save(routesSaveFile, std::move(savedRoutes), routesSaveFormat);
+}
+
+void RouteManager::loadRoutes() {
     if (routesSaveFile.empty()) return;
 
-    Logger::info("saving current routes to file");
+    LOGGER_INFO("loading saved routes from file");
+
+    // A standby keeps them for the promotion, neither installed nor probed
+    auto standby = Replication::isStandby();
+    std::vector<RouteSnapshot::Route> savedRoutes;
+    if (!RouteSnapshot::load(routesSaveFile, [&] (const RouteSnapshot::Route &route) {
+        LOGGER_VERBOSE("loaded route [{}]: {}", route.interface->name, route.address);
+        if (warmStart || standby) savedRoutes.push_back(route);
+        else probeCallback(route.address, route.interface);
+    })) {
+        LOGGER_ERROR("failed to load saved routes from {}", routesSaveFile);
+    }
+
+    if (standby) Replication::keepRoutes(savedRoutes);
+    else if (warmStart) installProvisionalRoutes(savedRoutes);
+}
 
-    std::vector<SerializedRoute> savedRoutes;
-    for (const auto [_, route] : routeExpiration) {
-        savedRoutes.push_back({route->address, route->interface});
+void RouteManager::installProvisionalRoutes(const std::vector<RouteSnapshot::Route> &savedRoutes) {
+    auto now = Clock::now();
+    // A route not seen for this long would have been deleted as expired, if we had kept running
+    auto maxAge = (time_t)(clampInterval(SIZE_MAX) + probeInterval * probeRetries);
+
+    std::vector<std::shared_ptr<RouteItem>> items;
+    items.reserve(savedRoutes.size());
+    for (const auto &savedRoute : savedRoutes) {
+        // The last-seen time is unknown for routes loaded from JSON
+        if (savedRoute.lastSeen != 0 && now - savedRoute.lastSeen > maxAge) {
+            LOGGER_VERBOSE("saved route [{}]: {} is stale, probing only", savedRoute.interface->name, savedRoute.address);
+            probeCallback(savedRoute.address, savedRoute.interface);
+            continue;
+        }
+
+        if (routes.count(savedRoute.address) != 0) continue;
+
+        items.push_back(insertProvisionalRoute(savedRoute.address, savedRoute.interface, savedRoute.lastSeen, now));
     }
+    Metrics::routes.set(routes.size());
+    Metrics::provisionalRoutes.add(items.size());
 
-    std::ofstream file(routesSaveFile);
-    cereal::JSONOutputArchive archive(file);
-    archive(CEREAL_NVP(savedRoutes));
+    updateRouteTableBatch(items, true);
+    LOGGER_INFO("installed {} provisional routes, verifying in background", items.size());
+
+    verifyProvisionalRoutes(now);
 }
 
-void RouteManager::loadRoutes() {
-    if (routesSaveFile.empty()) return;
+std::shared_ptr<RouteManager::RouteItem> RouteManager::insertProvisionalRoute(const Tins::IPv6Address &address, std::shared_ptr<Interface> interface, time_t lastSeen, time_t now) {
+    auto route = std::make_shared<RouteItem>();
+    route->address = address;
+    route->interface = interface;
+    route->lastProbe = now;
+    route->lastSeen = lastSeen;
+    route->probeRetries = 0;
+    route->interval = clampInterval(probeInterval);
+    route->provisional = true;
+    route->pinned = false;
+    route->itR = routes.insert(std::make_pair(route->address, route)).first;
+    scheduleProbe(route);
+    recordChange(*route, false);
+
+    provisionalRoutes.push_back(route);
+    return route;
+}
 
-    Logger::info("loading saved routes from file");
+bool RouteManager::addProvisionalRoute(const Tins::IPv6Address &address, std::shared_ptr<Interface> interface) {
+    if (routes.count(address) != 0) return false;
 
-    std::vector<SerializedRoute> savedRoutes;
+    auto now = Clock::now();
+    auto route = insertProvisionalRoute(address, interface, now, now);
+    Metrics::routesAdded.increment();
+    Metrics::routes.set(routes.size());
+    Metrics::provisionalRoutes.add(1);
+
+    updateRouteTable(route, true);
+    return true;
+}
 
-    std::ifstream file(routesSaveFile);
-    cereal::JSONInputArchive archive(file);
-    archive(CEREAL_NVP(savedRoutes));
+void RouteManager::verifyProvisionalRoutes(time_t now) {
+    // Probes are paced to at most warmStartProbeRate per second on average over a check interval
+    auto budget = std::max<size_t>(warmStartProbeRate * checkInterval, 1);
+    for (size_t i = provisionalRoutes.size(); i > 0 && budget > 0; i--) {
+        auto route = provisionalRoutes.front();
+        provisionalRoutes.pop_front();
+
+        // Skip the routes confirmed, moved or deleted since queued
+        auto itR = routes.find(route->address);
+        if (!route->provisional || itR == routes.end() || itR->second != route) continue;
+
+        // Verified at once, then retried at the probe interval like other routes, the budget
+        // only paces the probes due. Routes on a down interface wait for it
+        if ((route->probeRetries > 0 && now < getProbeDue(*route)) || !route->interface->up) {
+            provisionalRoutes.push_back(route);
+            continue;
+        }
 
-    for (const auto &route : savedRoutes) {
-        if (!route.interface) {
+        if (route->probeRetries >= probeRetries) {
+            LOGGER_INFO("deleting unconfirmed provisional route {} dev {}", route->address, route->interface->name);
+            Metrics::routesExpired.increment();
+            deleteRoute(route);
             continue;
         }
 
-        Logger::verbose("loaded route [{}]: {}", route.interface->name, route.address);
-        probeCallback(route.address, route.interface);
+        route->probeRetries++;
+        route->lastProbe = now;
+        LOGGER_VERBOSE("verifying provisional route {} dev {}, retry = {}", route->address, route->interface->name, route->probeRetries);
+        Metrics::probesSent.increment();
+        probeCallback(route->address, route->interface);
+
+        provisionalRoutes.push_back(route);
+        budget--;
     }
 }
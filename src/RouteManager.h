@@ -5,43 +5,174 @@
 #include <string>
 #include <ctime>
 #include <map>
+#include <deque>
+#include <list>
+#include <vector>
+#include <functional>
+#include <optional>
 #include <unordered_map>
 #include <tins/tins.h>
 
 #include "Interface.h"
+#include "RouteSnapshot.h"
+#include "RouteProgrammer.h"
 
 class RouteManager {
+public:
+    struct RouteInfo {
+        Tins::IPv6Address address;
+        std::shared_ptr<Interface> interface;
+        time_t lastProbe;
+        time_t lastSeen;
+        size_t probeRetries;
+        bool provisional;
+        bool pinned;
+        // Adapted probe interval, not kept across a handoff
+        size_t interval = 0;
+    };
+
+private:
+    struct RouteItem;
+
+    // The routes of one MAC address on an interface, the addresses of a host using temporary addresses
+    struct HostItem {
+        std::list<std::shared_ptr<RouteItem>> routes;
+        // Any of the addresses last confirmed
+        time_t lastSeen;
+        // Last probed through any of the addresses, and the probes unanswered since confirmed
+        time_t lastProbe;
+        size_t probeRetries;
+
+        std::map<std::pair<const Interface *, Tins::HWAddress<6>>, std::shared_ptr<HostItem>>::iterator itH;
+    };
+
     struct RouteItem {
         Tins::IPv6Address address;
         std::shared_ptr<Interface> interface;
         time_t lastProbe;
+        time_t lastSeen;
         size_t probeRetries;
+        // Seconds between probes, adapted to how stable the route has been. The retries are no slower
+        // than the probe interval
+        size_t interval;
+        // Restored from the saved file and installed without being confirmed yet
+        bool provisional;
+        // Pinned by the user, never reprobed, expired or moved
+        bool pinned;
+
+        // Grouped by MAC address, null if not grouped
+        std::shared_ptr<HostItem> host;
 
         std::unordered_map<Tins::IPv6Address, std::shared_ptr<RouteItem>>::iterator itR;
         std::multimap<time_t, std::shared_ptr<RouteItem>>::iterator itE;
+        std::list<std::shared_ptr<RouteItem>>::iterator itH;
     };
 
     static size_t checkInterval;
+    inline static size_t timerGeneration = 0;
     static size_t probeInterval;
     static size_t probeRetries;
+    // Bounds of the adapted intervals, 0 to keep the probe interval
+    inline static size_t minProbeInterval = 0, maxProbeInterval = 0;
     static std::string routesSaveFile;
+    static RouteSnapshot::Format routesSaveFormat;
+    static size_t routesSaveInterval;
+    static time_t lastRoutesSave;
+    static std::unordered_map<Tins::IPv6Address, RouteSnapshot::Route> changedRoutes;
+    static bool warmStart;
+    static size_t warmStartProbeRate;
     static std::function<void (Tins::IPv6Address, std::shared_ptr<Interface>)> probeCallback;
+    static std::unique_ptr<RouteProgrammer> routeProgrammer;
+    // Handed over to another process, which owns the system routes from now on
+    inline static bool handedOver = false;
 
     static std::unordered_map<Tins::IPv6Address, std::shared_ptr<RouteItem>> routes;
     static std::multimap<time_t, std::shared_ptr<RouteItem>> routeExpiration;
+    static std::deque<std::shared_ptr<RouteItem>> provisionalRoutes;
+    // Routes grouped by MAC address if not 0, and each still verified itself after this long
+    inline static size_t macVerifyInterval = 0;
+    inline static std::map<std::pair<const Interface *, Tins::HWAddress<6>>, std::shared_ptr<HostItem>> hosts;
 
     static void deleteRoute(std::shared_ptr<RouteItem> item);
+    static void setHost(std::shared_ptr<RouteItem> item, const Tins::HWAddress<6> &macAddress);
+    static void unsetHost(RouteItem &item);
+    // Extend the other routes of the host, confirmed through one of them
+    static void confirmHost(const RouteItem &item, time_t now);
+    // Due for a probe, but alive as another address of its host was confirmed or is probed now
+    static bool isCoveredByHost(const RouteItem &item, time_t now);
     static void updateRouteTable(std::shared_ptr<RouteItem> item, bool isAdd);
-    static void printManagedRoutes();
+    static void updateRouteTableBatch(const std::vector<std::shared_ptr<RouteItem>> &items, bool isAdd);
+    static RouteInfo toRouteInfo(const RouteItem &item);
+    // The time the route is due for its next probe, the key in routeExpiration
+    static time_t getProbeDue(const RouteItem &item);
+    // Add the route to routeExpiration at its next probe, or remove it. Provisional routes are
+    // left out, verifyProvisionalRoutes paces their probes
+    static void scheduleProbe(const std::shared_ptr<RouteItem> &item);
+    static void unscheduleProbe(RouteItem &item);
+    static size_t clampInterval(size_t interval);
+    // Re-sort the routes by their next probe, after the intervals changed
+    static void rescheduleProbes();
+    static std::vector<RouteProgrammer::Route> getRoutesExcept(const Interface &interface);
 
     static void setTimer();
-    static void processTimerTick(int);
-    static void saveRoutes();
+    static void processTimerTick();
     static void loadRoutes();
+    static std::shared_ptr<RouteItem> insertProvisionalRoute(const Tins::IPv6Address &address, std::shared_ptr<Interface> interface, time_t lastSeen, time_t now);
+    static void installProvisionalRoutes(const std::vector<RouteSnapshot::Route> &savedRoutes);
+    static void verifyProvisionalRoutes(time_t now);
+    static void recordChange(const RouteItem &item, bool isDelete);
     static void onExit();
 
 public:
-    static void initialize(size_t checkInterval, size_t probeInterval, size_t probeRetries, const std::string &routesSaveFile, std::function<void (Tins::IPv6Address, std::shared_ptr<Interface>)> probeCallback);
-    static void addOrRefreshRoute(const Tins::IPv6Address &address, std::shared_ptr<Interface> interface);
+    static void initialize(size_t checkInterval, size_t probeInterval, size_t probeRetries, const std::string &routesSaveFile, RouteSnapshot::Format routesSaveFormat, size_t routesSaveInterval, bool warmStart, size_t warmStartProbeRate, std::function<void (Tins::IPv6Address, std::shared_ptr<Interface>)> probeCallback);
+    // Replace the "ip" command, e.g. to run without touching the system routing table
+    static void setRouteProgrammer(std::unique_ptr<RouteProgrammer> routeProgrammer);
+
+    // Returns true if a new route is installed. The MAC address of the host, if known, groups its routes
+    static bool addOrRefreshRoute(const Tins::IPv6Address &address, std::shared_ptr<Interface> interface, const std::optional<Tins::HWAddress<6>> &macAddress = std::nullopt);
     static std::shared_ptr<Interface> getRoute(const Tins::IPv6Address &address);
+    // Install a route believed but not confirmed yet, verified by probes like the warm start ones.
+    // Returns false if there is a route already
+    static bool addProvisionalRoute(const Tins::IPv6Address &address, std::shared_ptr<Interface> interface);
+
+    // Inspection and manipulation for the control socket
+    static std::optional<RouteInfo> lookupRoute(const Tins::IPv6Address &address);
+    // Visit routes in buckets starting from cursor, until at least limit routes visited. Returns the next
+    // cursor, or 0 after the last bucket. The iteration is weakly consistent when routes change in between
+    static size_t visitRoutes(size_t cursor, size_t limit, const std::function<void (const RouteInfo &)> &callback);
+    static bool reprobeRoute(const Tins::IPv6Address &address);
+    // Pin an existing route, or add or move it to the interface if given
+    static bool pinRoute(const Tins::IPv6Address &address, std::shared_ptr<Interface> interface);
+    static bool unpinRoute(const Tins::IPv6Address &address);
+    static bool removeRoute(const Tins::IPv6Address &address);
+    // Stop announcing the routes of an interface down or removed elsewhere, until resumed
+    static void suspendInterface(std::shared_ptr<Interface> interface);
+    // Reinstall the routes of an interface back up, suspended while it was down
+    static void resumeInterface(std::shared_ptr<Interface> interface);
+    // Start relaying an interface added at runtime
+    static void addInterface(std::shared_ptr<Interface> interface);
+    // Delete the routes of an interface no longer relayed
+    static void removeInterface(std::shared_ptr<Interface> interface);
+    // Apply new probing arguments to the existing routes
+    static void reconfigure(size_t checkInterval, size_t probeInterval, size_t probeRetries);
+    // Probe each route at its own interval within these bounds (seconds): doubled each time it answers
+    // the first probe, halved when it needs retries, and the shortest after it moved. 0 to keep the
+    // probe interval
+    static void adaptProbeInterval(size_t minInterval, size_t maxInterval);
+    // Confirm all routes of a MAC address by probing any one of them, each still probed itself after
+    // the verify interval (seconds). 0 to probe every route on its own
+    static void groupByMacAddress(size_t verifyInterval);
+    static size_t getRouteCount();
+
+    // Take the routes handed over by the previous process, before initialize(). They're already in
+    // the system routing table, and replace the saved routes file
+    static void adoptRoutes(const std::vector<RouteInfo> &routes);
+    // Install routes believed to be alive, verified by probes like the warm start ones
+    static void installRoutes(const std::vector<RouteSnapshot::Route> &routes);
+    // Delete all routes from the system routing table and return them, becoming standby
+    static std::vector<RouteSnapshot::Route> releaseRoutes();
+    // Write the routes file now, before handing over to another process
+    static void saveRoutes();
+    // Exit without deleting the routes or saving them again
+    static void keepRoutesOnExit();
 };
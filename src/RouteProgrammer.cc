@@ -0,0 +1,234 @@
+#include "RouteProgrammer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/neighbour.h>
+#include <fmt/format.h>
+
+#include "Ensure/Ensure.h"
+#include "Logger.h"
+#include "Interface.h"
+
+bool IpCommandRouteProgrammer::update(const Tins::IPv6Address &address, const Interface &interface, bool isAdd) {
+    auto command = fmt::format("ip -6 route {} {} dev {}", (isAdd ? "add" : "del"), address, interface.name);
+    LOGGER_INFO("executing '{}'", command);
+
+    if (system(command.c_str()) != 0) {
+        LOGGER_ERROR("command failed!");
+        return false;
+    }
+
+    return true;
+}
+
+bool IpCommandRouteProgrammer::updateBatch(const std::vector<Route> &routes, bool isAdd) {
+    if (routes.empty()) return true;
+
+    // One "ip" process for all routes instead of one per route
+    constexpr auto COMMAND = "ip -force -6 -batch -";
+    LOGGER_INFO("executing '{}' for {} routes", COMMAND, routes.size());
+
+    auto pipe = popen(COMMAND, "w");
+    if (!pipe) {
+        LOGGER_ERROR("failed to execute '{}'", COMMAND);
+        return false;
+    }
+
+    for (const auto &[address, interface] : routes) {
+        auto line = fmt::format("route {} {} dev {}\n", (isAdd ? "replace" : "del"), address, interface->name);
+        fwrite(line.data(), 1, line.size(), pipe);
+    }
+
+    if (pclose(pipe) != 0) {
+        LOGGER_ERROR("command failed!");
+        return false;
+    }
+
+    return true;
+}
+
+struct ProxyNeighborRequest {
+    nlmsghdr header;
+    ndmsg neighbor;
+    rtattr destinationAttribute;
+    uint8_t destination[Tins::IPv6Address::address_size];
+};
+
+static_assert(sizeof(ProxyNeighborRequest) == NLMSG_LENGTH(sizeof(ndmsg)) + RTA_LENGTH(Tins::IPv6Address::address_size));
+
+static std::string readSysctl(const std::string &path) {
+    std::ifstream file(path);
+    std::string value;
+    file >> value;
+    return value;
+}
+
+static bool writeSysctl(const std::string &path, const char *value) {
+    std::ofstream file(path);
+    file << value << std::endl;
+    return file.good();
+}
+
+ProxyNdpRouteProgrammer::ProxyNdpRouteProgrammer(std::unique_ptr<RouteProgrammer> inner) : inner(std::move(inner)) {
+    ENSURE_ERRNO(fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE));
+
+    // Only the error code in the acknowledgements, not the whole request
+    int capAck = 1;
+    setsockopt(fd, SOL_NETLINK, NETLINK_CAP_ACK, &capAck, sizeof(capAck));
+    timeval timeout = {5, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    for (const auto &[_, interface] : Interface::interfaces) enableOnInterface(*interface);
+}
+
+ProxyNdpRouteProgrammer::~ProxyNdpRouteProgrammer() {
+    close(fd);
+}
+
+void ProxyNdpRouteProgrammer::enableOnInterface(const Interface &interface) {
+    if (!interface.tinsInterface.id()) return;
+
+    if (readSysctl(fmt::format("/proc/sys/net/ipv6/conf/{}/forwarding", interface.name)) == "0")
+        LOGGER_WARNING("forwarding is disabled on {}, the kernel doesn't answer NS for proxy neighbors there", interface.name);
+
+    // Answer at once, instead of after a random delay of up to proxy_delay (0.8s by default)
+    if (
+        !writeSysctl(fmt::format("/proc/sys/net/ipv6/conf/{}/proxy_ndp", interface.name), "1") ||
+        !writeSysctl(fmt::format("/proc/sys/net/ipv6/neigh/{}/proxy_delay", interface.name), "0")
+    ) {
+        LOGGER_WARNING("failed to enable proxy_ndp on {}, the kernel doesn't answer NS there", interface.name);
+    }
+}
+
+std::vector<std::pair<Tins::IPv6Address, int>> ProxyNdpRouteProgrammer::entriesOf(const std::vector<Route> &routes) {
+    std::vector<std::pair<Tins::IPv6Address, int>> entries;
+    for (const auto &[_, interface] : Interface::interfaces) {
+        // Virtual interfaces, and removed ones waiting to be back
+        auto index = interface->tinsInterface.id();
+        if (!index) continue;
+
+        for (const auto &[address, routeInterface] : routes)
+            if (routeInterface != interface) entries.emplace_back(address, index);
+    }
+
+    return entries;
+}
+
+bool ProxyNdpRouteProgrammer::updateEntries(const std::vector<std::pair<Tins::IPv6Address, int>> &entries, bool isAdd) {
+    // Send in chunks, and read the acknowledgements of each before the next
+    constexpr size_t CHUNK_SIZE = 256;
+
+    size_t failures = 0;
+    int lastError = 0;
+    for (size_t begin = 0; begin < entries.size(); begin += CHUNK_SIZE) {
+        auto end = std::min(begin + CHUNK_SIZE, entries.size());
+
+        std::vector<ProxyNeighborRequest> requests(end - begin);
+        for (size_t i = begin; i < end; i++) {
+            auto &request = requests[i - begin];
+            request = {};
+            request.header.nlmsg_len = sizeof(ProxyNeighborRequest);
+            request.header.nlmsg_type = isAdd ? RTM_NEWNEIGH : RTM_DELNEIGH;
+            request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | (isAdd ? NLM_F_CREATE | NLM_F_REPLACE : 0);
+            request.header.nlmsg_seq = ++sequence;
+            request.neighbor.ndm_family = AF_INET6;
+            request.neighbor.ndm_ifindex = entries[i].second;
+            request.neighbor.ndm_flags = NTF_PROXY;
+            request.destinationAttribute.rta_len = RTA_LENGTH(sizeof(request.destination));
+            request.destinationAttribute.rta_type = NDA_DST;
+            std::copy(entries[i].first.begin(), entries[i].first.end(), request.destination);
+        }
+
+        auto size = requests.size() * sizeof(ProxyNeighborRequest);
+        if (send(fd, requests.data(), size, 0) != (ssize_t)size) {
+            LOGGER_ERROR("failed to send proxy neighbor requests: {}", strerror(errno));
+            return false;
+        }
+
+        char buffer[8192];
+        for (size_t pending = requests.size(); pending > 0; ) {
+            auto received = recv(fd, buffer, sizeof(buffer), 0);
+            if (received < 0 && errno == EINTR) continue;
+            if (received <= 0) {
+                LOGGER_ERROR("failed to receive proxy neighbor acknowledgements: {}", strerror(errno));
+                return false;
+            }
+
+            int length = received;
+            for (auto header = reinterpret_cast<nlmsghdr *>(buffer); NLMSG_OK(header, length); header = NLMSG_NEXT(header, length)) {
+                if (header->nlmsg_type != NLMSG_ERROR) continue;
+                pending--;
+
+                // Deleting an entry already gone with its interface is fine
+                auto error = static_cast<nlmsgerr *>(NLMSG_DATA(header))->error;
+                if (error != 0 && !(error == -ENOENT && !isAdd)) {
+                    failures++;
+                    lastError = -error;
+                }
+            }
+        }
+    }
+
+    if (failures != 0) {
+        LOGGER_ERROR("failed to {} {} of {} proxy neighbor entries: {}", isAdd ? "add" : "delete", failures, entries.size(), strerror(lastError));
+        return false;
+    }
+
+    return true;
+}
+
+bool ProxyNdpRouteProgrammer::update(const Tins::IPv6Address &address, const Interface &interface, bool isAdd) {
+    auto success = inner->update(address, interface, isAdd);
+
+    std::vector<std::pair<Tins::IPv6Address, int>> entries;
+    for (const auto &[_, other] : Interface::interfaces)
+        if (other.get() != &interface && other->tinsInterface.id()) entries.emplace_back(address, other->tinsInterface.id());
+    LOGGER_VERBOSE("{} proxy neighbor {} on {} interfaces", isAdd ? "adding" : "deleting", address, entries.size());
+
+    return updateEntries(entries, isAdd) && success;
+}
+
+bool ProxyNdpRouteProgrammer::updateBatch(const std::vector<Route> &routes, bool isAdd) {
+    auto success = inner->updateBatch(routes, isAdd);
+
+    auto entries = entriesOf(routes);
+    LOGGER_INFO("{} {} proxy neighbor entries", isAdd ? "adding" : "deleting", entries.size());
+    return updateEntries(entries, isAdd) && success;
+}
+
+void ProxyNdpRouteProgrammer::addInterface(const Interface &interface, const std::vector<Route> &routes) {
+    // Added, or re-created without the entries
+    enableOnInterface(interface);
+    auto index = interface.tinsInterface.id();
+    if (!index) return;
+
+    std::vector<std::pair<Tins::IPv6Address, int>> entries;
+    for (const auto &[address, _] : routes) entries.emplace_back(address, index);
+    LOGGER_INFO("adding {} proxy neighbor entries on {}", entries.size(), interface.name);
+    updateEntries(entries, true);
+}
+
+void ProxyNdpRouteProgrammer::removeInterface(const Interface &interface, const std::vector<Route> &routes) {
+    auto index = interface.tinsInterface.id();
+    if (!index) return;
+
+    std::vector<std::pair<Tins::IPv6Address, int>> entries;
+    for (const auto &[address, _] : routes) entries.emplace_back(address, index);
+    LOGGER_INFO("deleting {} proxy neighbor entries on {}", entries.size(), interface.name);
+    updateEntries(entries, false);
+}
+
+void ProxyNdpRouteProgrammer::suspendRoutes(const std::vector<Route> &routes) {
+    // Answering NS for them on the other interfaces would black-hole the traffic
+    auto entries = entriesOf(routes);
+    LOGGER_INFO("deleting {} proxy neighbor entries of suspended routes", entries.size());
+    updateEntries(entries, false);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <utility>
+#include <tins/tins.h>
+
+struct Interface;
+
+// Installs and deletes host routes in the system routing table
+class RouteProgrammer {
+public:
+    using Route = std::pair<Tins::IPv6Address, std::shared_ptr<Interface>>;
+
+    virtual ~RouteProgrammer() = default;
+
+    // Returns false on failure
+    virtual bool update(const Tins::IPv6Address &address, const Interface &interface, bool isAdd) = 0;
+    // Add (replacing existing ones) or delete many routes at once
+    virtual bool updateBatch(const std::vector<Route> &routes, bool isAdd) = 0;
+    // An interface is relayed from now on (again), or no longer, given the routes on the other
+    // interfaces. For programmers keeping state on every interface, not only on the route's one
+    virtual void addInterface(const Interface &, const std::vector<Route> &) {}
+    virtual void removeInterface(const Interface &, const std::vector<Route> &) {}
+    // The routes of an interface down or removed are kept, but unreachable until it's back, when
+    // they're added again
+    virtual void suspendRoutes(const std::vector<Route> &) {}
+};
+
+// Runs the "ip" command
+class IpCommandRouteProgrammer : public RouteProgrammer {
+public:
+    bool update(const Tins::IPv6Address &address, const Interface &interface, bool isAdd) override;
+    bool updateBatch(const std::vector<Route> &routes, bool isAdd) override;
+};
+
+// Also maintains a proxy neighbor entry (NTF_PROXY) of each route on all the other interfaces with
+// rtnetlink, and enables proxy_ndp on them, so the kernel answers NS for known routes itself. The
+// routes are programmed by the inner programmer
+class ProxyNdpRouteProgrammer : public RouteProgrammer {
+    std::unique_ptr<RouteProgrammer> inner;
+    int fd;
+    uint32_t sequence = 0;
+
+    // Add or delete the entries of addresses on interface indexes. Returns false if any failed
+    bool updateEntries(const std::vector<std::pair<Tins::IPv6Address, int>> &entries, bool isAdd);
+    // The entries of the routes on all interfaces but their own
+    static std::vector<std::pair<Tins::IPv6Address, int>> entriesOf(const std::vector<Route> &routes);
+    static void enableOnInterface(const Interface &interface);
+
+public:
+    explicit ProxyNdpRouteProgrammer(std::unique_ptr<RouteProgrammer> inner);
+    ~ProxyNdpRouteProgrammer() override;
+
+    bool update(const Tins::IPv6Address &address, const Interface &interface, bool isAdd) override;
+    bool updateBatch(const std::vector<Route> &routes, bool isAdd) override;
+    void addInterface(const Interface &interface, const std::vector<Route> &routes) override;
+    void removeInterface(const Interface &interface, const std::vector<Route> &routes) override;
+    void suspendRoutes(const std::vector<Route> &routes) override;
+};
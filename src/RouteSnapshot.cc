@@ -0,0 +1,247 @@
+#include "RouteSnapshot.h"
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <unordered_map>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cereal/archives/json.hpp>
+#include <cereal/types/vector.hpp>
+
+#include "Logger.h"
+
+struct SerializedRoute {
+    Tins::IPv6Address address;
+    std::shared_ptr<Interface> interface;
+
+    template <class Archive>
+    void save(Archive &archive) const {
+        archive(address.to_string(), interface->name);
+    }
+
+    template <class Archive>
+    void load(Archive &archive) {
+        std::string address, interfaceName;
+        archive(address, interfaceName);
+        
+        this->address = address;
+
+        auto it = Interface::interfaces.find(interfaceName);
+        if (it != Interface::interfaces.end()) {
+            this->interface = it->second;
+        } else {
+            LOGGER_WARNING("found previous route on unknown interface [{}]: {}", interfaceName, address);
+        }
+    }
+};
+
+bool RouteSnapshot::isSnapshotFile(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    char magic[sizeof(MAGIC)];
+    auto size = read(fd, magic, sizeof(magic));
+    close(fd);
+
+    return size == sizeof(magic) && std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+std::string RouteSnapshot::serialize(std::vector<Route> routes) {
+    std::sort(routes.begin(), routes.end(), [] (const Route &a, const Route &b) {
+        return std::memcmp(a.address.begin(), b.address.begin(), Tins::IPv6Address::address_size) < 0;
+    });
+
+    // Assign interface IDs in order of first appearance
+    std::vector<const Interface *> interfaceTable;
+    std::unordered_map<const Interface *, uint32_t> interfaceIds;
+    for (const auto &route : routes) {
+        if (interfaceIds.emplace(route.interface.get(), interfaceTable.size()).second)
+            interfaceTable.push_back(route.interface.get());
+    }
+
+    std::string buffer(sizeof(Header) + interfaceTable.size() * sizeof(InterfaceName) + routes.size() * sizeof(Entry), '\0');
+    auto p = buffer.data();
+
+    auto header = reinterpret_cast<Header *>(p);
+    std::memcpy(header->magic, MAGIC, sizeof(MAGIC));
+    header->version = VERSION;
+    header->interfaceCount = interfaceTable.size();
+    header->routeCount = routes.size();
+    header->createdAt = std::time(nullptr);
+    p += sizeof(Header);
+
+    for (auto interface : interfaceTable) {
+        auto entry = reinterpret_cast<InterfaceName *>(p);
+        std::strncpy(entry->name, interface->name.c_str(), sizeof(entry->name) - 1);
+        p += sizeof(InterfaceName);
+    }
+
+    for (const auto &route : routes) {
+        auto entry = reinterpret_cast<Entry *>(p);
+        std::copy(route.address.begin(), route.address.end(), entry->address);
+        entry->interfaceId = interfaceIds[route.interface.get()];
+        entry->lastSeen = route.lastSeen;
+        p += sizeof(Entry);
+    }
+
+    return buffer;
+}
+
+bool RouteSnapshot::parse(const void *data, size_t size, const std::function<void (const Route &)> &callback) {
+    auto p = static_cast<const char *>(data);
+
+    if (size < sizeof(Header)) return false;
+    auto header = reinterpret_cast<const Header *>(p);
+    if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0) return false;
+    if (header->version != VERSION) {
+        LOGGER_ERROR("unsupported route snapshot version {}", header->version);
+        return false;
+    }
+    if (
+        header->routeCount > size / sizeof(Entry) ||
+        size != sizeof(Header) + header->interfaceCount * sizeof(InterfaceName) + header->routeCount * sizeof(Entry)
+    ) {
+        LOGGER_ERROR("route snapshot size mismatch, file truncated?");
+        return false;
+    }
+    p += sizeof(Header);
+
+    // Resolve the interface table once
+    std::vector<std::shared_ptr<Interface>> interfaces(header->interfaceCount);
+    for (size_t i = 0; i < header->interfaceCount; i++) {
+        auto entry = reinterpret_cast<const InterfaceName *>(p);
+        std::string name(entry->name, strnlen(entry->name, sizeof(entry->name)));
+        if (auto it = Interface::interfaces.find(name); it != Interface::interfaces.end())
+            interfaces[i] = it->second;
+        else
+            LOGGER_WARNING("found previous routes on unknown interface [{}]", name);
+        p += sizeof(InterfaceName);
+    }
+
+    auto entries = reinterpret_cast<const Entry *>(p);
+    for (size_t i = 0; i < header->routeCount; i++) {
+        const auto &entry = entries[i];
+        if (entry.interfaceId >= interfaces.size()) return false;
+        if (!interfaces[entry.interfaceId]) continue;
+
+        callback({Tins::IPv6Address(entry.address), interfaces[entry.interfaceId], static_cast<time_t>(entry.lastSeen)});
+    }
+
+    return true;
+}
+
+bool RouteSnapshot::writeFile(const std::string &path, const std::string &buffer) {
+    // Write to a temporary file and rename over the old one, so a crash never leaves a partial snapshot
+    auto temporaryPath = path + ".tmp";
+    int fd = open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        LOGGER_ERROR("failed to open {}: {}", temporaryPath, strerror(errno));
+        return false;
+    }
+
+    for (size_t written = 0; written < buffer.size(); ) {
+        auto result = write(fd, buffer.data() + written, buffer.size() - written);
+        if (result < 0) {
+            if (errno == EINTR) continue;
+            LOGGER_ERROR("failed to write {}: {}", temporaryPath, strerror(errno));
+            close(fd);
+            unlink(temporaryPath.c_str());
+            return false;
+        }
+        written += result;
+    }
+
+    fsync(fd);
+    close(fd);
+
+    if (rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        LOGGER_ERROR("failed to replace {}: {}", path, strerror(errno));
+        unlink(temporaryPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+size_t RouteSnapshot::save(const std::string &path, std::vector<Route> routes, Format format) {
+    std::string buffer;
+    if (format == JSON) {
+        std::vector<SerializedRoute> savedRoutes;
+        savedRoutes.reserve(routes.size());
+        for (const auto &route : routes) {
+            savedRoutes.push_back({route.address, route.interface});
+        }
+
+        std::ostringstream stream;
+        {
+            cereal::JSONOutputArchive archive(stream);
+            archive(CEREAL_NVP(savedRoutes));
+        }
+        buffer = stream.str();
+    } else {
+        buffer = serialize(std::move(routes));
+    }
+
+    return writeFile(path, buffer) ? buffer.size() : 0;
+}
+
+bool RouteSnapshot::load(const std::string &path, const std::function<void (const Route &)> &callback) {
+    return isSnapshotFile(path) ? loadBinary(path, callback) : loadJson(path, callback);
+}
+
+bool RouteSnapshot::loadJson(const std::string &path, const std::function<void (const Route &)> &callback) {
+    std::vector<SerializedRoute> savedRoutes;
+
+    try {
+        std::ifstream file(path);
+        cereal::JSONInputArchive archive(file);
+        archive(CEREAL_NVP(savedRoutes));
+    } catch (const std::exception &e) {
+        LOGGER_ERROR("failed to parse {}: {}", path, e.what());
+        return false;
+    }
+
+    for (const auto &route : savedRoutes) {
+        if (!route.interface) {
+            continue;
+        }
+
+        // JSON doesn't carry the last-seen time
+        callback({route.address, route.interface, 0});
+    }
+
+    return true;
+}
+
+bool RouteSnapshot::loadBinary(const std::string &path, const std::function<void (const Route &)> &callback) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOGGER_ERROR("failed to open {}: {}", path, strerror(errno));
+        return false;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    size_t size = fileStat.st_size;
+    auto data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        LOGGER_ERROR("failed to mmap {}: {}", path, strerror(errno));
+        return false;
+    }
+
+    madvise(data, size, MADV_SEQUENTIAL);
+    auto success = parse(data, size, callback);
+    munmap(data, size);
+
+    return success;
+}
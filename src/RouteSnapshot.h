@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include <net/if.h>
+#include <tins/tins.h>
+
+#include "Interface.h"
+
+// Binary route snapshot, designed to be mmap-ed and consumed without parsing:
+//
+//   Header
+//   InterfaceName[interfaceCount]
+//   Entry[routeCount]                         (sorted by address)
+//
+// All fields are in host byte order. Every record has a size of a multiple of 8 so
+// the entries are naturally aligned in the mapping.
+class RouteSnapshot {
+public:
+    enum Format {
+        BINARY,
+        JSON
+    };
+
+    static constexpr char MAGIC[8] = {'M', 'A', 'G', 'P', 'I', 'E', 'R', 'T'};
+    static constexpr uint32_t VERSION = 1;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t interfaceCount;
+        uint64_t routeCount;
+        int64_t createdAt;
+    };
+
+    struct InterfaceName {
+        char name[IFNAMSIZ];
+    };
+
+    struct Entry {
+        uint8_t address[Tins::IPv6Address::address_size];
+        uint32_t interfaceId;
+        uint32_t flags; // Reserved, zero
+        int64_t lastSeen;
+    };
+
+    static_assert(sizeof(Header) == 32);
+    static_assert(sizeof(InterfaceName) == 16);
+    static_assert(sizeof(Entry) == 32);
+
+    struct Route {
+        Tins::IPv6Address address;
+        std::shared_ptr<Interface> interface;
+        time_t lastSeen;
+    };
+
+    // Serialize routes into the binary format
+    static std::string serialize(std::vector<Route> routes);
+    // Call the callback for each route on a known interface. Returns false on malformed data
+    static bool parse(const void *data, size_t size, const std::function<void (const Route &)> &callback);
+
+    // Serialize and atomically replace the file. Returns the size written, or 0 on failure
+    static size_t save(const std::string &path, std::vector<Route> routes, Format format);
+    // Load a file in either format, detected by content. Binary files are mapped and parsed in place
+    static bool load(const std::string &path, const std::function<void (const Route &)> &callback);
+
+private:
+    static bool isSnapshotFile(const std::string &path);
+    static bool writeFile(const std::string &path, const std::string &buffer);
+    static bool loadBinary(const std::string &path, const std::function<void (const Route &)> &callback);
+    static bool loadJson(const std::string &path, const std::function<void (const Route &)> &callback);
+};
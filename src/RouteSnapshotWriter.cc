@@ -0,0 +1,78 @@
+#include "RouteSnapshotWriter.h"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <signal.h>
+
+#include "Logger.h"
+#include "Metrics.h"
+
+std::string RouteSnapshotWriter::path;
+RouteSnapshot::Format RouteSnapshotWriter::format;
+
+Queue<RouteSnapshotWriter::Changes> RouteSnapshotWriter::queue;
+std::unordered_map<Tins::IPv6Address, RouteSnapshot::Route> RouteSnapshotWriter::mirror;
+
+std::mutex RouteSnapshotWriter::mutex;
+std::condition_variable RouteSnapshotWriter::cv;
+size_t RouteSnapshotWriter::submitted;
+size_t RouteSnapshotWriter::written;
+
+void RouteSnapshotWriter::initialize(const std::string &path, RouteSnapshot::Format format) {
+    RouteSnapshotWriter::path = path;
+    RouteSnapshotWriter::format = format;
+
+    std::thread(writerLoop).detach();
+}
+
+void RouteSnapshotWriter::submit(Changes &&changes) {
+    {
+        std::lock_guard lock(mutex);
+        submitted++;
+    }
+
+    queue.push(std::move(changes));
+}
+
+void RouteSnapshotWriter::flush() {
+    std::unique_lock lock(mutex);
+    cv.wait(lock, [] { return written == submitted; });
+}
+
+void RouteSnapshotWriter::writerLoop() {
+    // Signal handlers touch the routing table, never run them on this thread
+    sigset_t signals;
+    sigfillset(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    while (true) {
+        auto changes = queue.pop();
+
+        auto startTime = std::chrono::steady_clock::now();
+
+        for (auto &[address, route] : changes) {
+            if (route.interface) mirror[address] = std::move(route);
+            else mirror.erase(address);
+        }
+
+        std::vector<RouteSnapshot::Route> routes;
+        routes.reserve(mirror.size());
+        for (const auto &[_, route] : mirror) routes.push_back(route);
+
+        auto size = RouteSnapshot::save(path, std::move(routes), format);
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime);
+        if (size > 0) {
+            LOGGER_INFO("saved snapshot of {} routes ({} changed, {} bytes) in {:.3f} ms", mirror.size(), changes.size(), size, duration.count() / 1000.0);
+            Metrics::snapshotsWritten.increment();
+            Metrics::lastSnapshotBytes.set(size);
+            Metrics::lastSnapshotMicroseconds.set(duration.count());
+        }
+
+        {
+            std::lock_guard lock(mutex);
+            written++;
+            cv.notify_all();
+        }
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <tins/tins.h>
+
+#include "Queue.h"
+#include "RouteSnapshot.h"
+
+// Writes route snapshots on a background thread. The owner of the routing table only
+// hands over the routes changed since the last snapshot, the full table is mirrored here.
+class RouteSnapshotWriter {
+public:
+    // Changed routes by address, a route with null interface means it's deleted
+    using Changes = std::unordered_map<Tins::IPv6Address, RouteSnapshot::Route>;
+
+private:
+    static std::string path;
+    static RouteSnapshot::Format format;
+
+    static Queue<Changes> queue;
+    static std::unordered_map<Tins::IPv6Address, RouteSnapshot::Route> mirror;
+
+    static std::mutex mutex;
+    static std::condition_variable cv;
+    static size_t submitted, written;
+
+    static void writerLoop();
+
+public:
+    static void initialize(const std::string &path, RouteSnapshot::Format format);
+    static void submit(Changes &&changes);
+    // Wait for all submitted changes to be written
+    static void flush();
+};
@@ -0,0 +1,67 @@
+#include "Scheduling.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include "Logger.h"
+
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+
+void Scheduling::initialize(
+    const std::vector<int> &captureCpus,
+    const std::vector<int> &processingCpus,
+    int realtimePriority,
+    int busyPollMicroseconds,
+    bool lockMemory
+) {
+    Scheduling::captureCpus = captureCpus;
+    Scheduling::processingCpus = processingCpus;
+    Scheduling::realtimePriority = realtimePriority;
+    Scheduling::busyPollMicroseconds = busyPollMicroseconds;
+
+    // Only the pages touched are locked, instead of the whole stack of every thread
+    if (lockMemory && mlockall(MCL_CURRENT | MCL_FUTURE | MCL_ONFAULT) != 0)
+        LOGGER_WARNING("failed to lock memory: {}", strerror(errno));
+}
+
+void Scheduling::applyToThread(const std::vector<int> &cpus, const char *role) {
+    if (!cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (auto cpu : cpus) CPU_SET(cpu, &set);
+
+        if (sched_setaffinity(0, sizeof(set), &set) != 0)
+            LOGGER_WARNING("failed to pin {} thread to its CPUs: {}", role, strerror(errno));
+    }
+
+    if (realtimePriority != 0) {
+        // The "ip" commands run from the main loop go back to the normal policy
+        sched_param param = {};
+        param.sched_priority = realtimePriority;
+        if (sched_setscheduler(0, SCHED_FIFO | SCHED_RESET_ON_FORK, &param) != 0)
+            LOGGER_WARNING("failed to set SCHED_FIFO priority {} on {} thread: {}", realtimePriority, role, strerror(errno));
+    }
+}
+
+void Scheduling::applyToCaptureThread(int fd) {
+    applyToThread(captureCpus, "capture");
+
+    if (busyPollMicroseconds != 0 && fd >= 0) {
+        int prefer = 1;
+        if (
+            setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &busyPollMicroseconds, sizeof(busyPollMicroseconds)) != 0 ||
+            setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer)) != 0
+        ) {
+            LOGGER_WARNING("failed to enable busy polling on capture socket: {}", strerror(errno));
+        }
+    }
+}
+
+void Scheduling::applyToProcessingThread() {
+    applyToThread(processingCpus, "processing");
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vector>
+
+// Keeps the packet path off the cores and time slices of other daemons, so the NS response latency
+// stays stable on a shared router: pins the capture threads and the main loop to CPUs, runs them
+// with SCHED_FIFO, busy-polls the capture sockets and locks the memory.
+class Scheduling {
+    inline static std::vector<int> captureCpus, processingCpus;
+    inline static int realtimePriority = 0;
+    inline static int busyPollMicroseconds = 0;
+
+    static void applyToThread(const std::vector<int> &cpus, const char *role);
+
+public:
+    // Empty CPU lists, and 0 for the priority and busy poll, leave them as is
+    static void initialize(
+        const std::vector<int> &captureCpus,
+        const std::vector<int> &processingCpus,
+        int realtimePriority,
+        int busyPollMicroseconds,
+        bool lockMemory
+    );
+
+    // On a capture thread, with its capture socket
+    static void applyToCaptureThread(int fd);
+    // On the main loop thread, after the other threads are created as they'd inherit it
+    static void applyToProcessingThread();
+};
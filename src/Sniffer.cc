@@ -1,48 +1,212 @@
 #include "Sniffer.h"
 
-#include <thread>
-#include <mutex>
-#include <condition_variable>
+#include <algorithm>
 #include <fmt/format.h>
 
-#include "Ensure/Ensure.h"
 #include "Interface.h"
 #include "Logger.h"
 #include "NDP.h"
 #include "RouteManager.h"
 #include "RequestManager.h"
+#include "Clock.h"
+#include "LocationHistory.h"
+
+Queue<Sniffer::QueueItem> Sniffer::queue;
+std::unordered_set<Tins::IPv6Address> Sniffer::pendingFallbacks;
+std::unordered_set<Tins::IPv6Address> Sniffer::pendingDuplicateAddressDetections;
+
+static const auto UNSPECIFIED = Tins::IPv6Address();
+static const auto ALL_NODES = Tins::IPv6Address("ff02::1");
+static const auto ALL_NODES_MAC = Tins::HWAddress<6>("33:33:00:00:00:01");
+// RetransTimer of RFC 4861, after which a host takes the address if no conflict is found
+constexpr auto DUPLICATE_ADDRESS_DETECTION_TIMEOUT = std::chrono::milliseconds(1000);
+// A route confirmed this recently (seconds) is defended in DAD right away, an older one is probed first
+constexpr time_t DUPLICATE_ADDRESS_CONFIRMED_RECENTLY = 5;
+constexpr auto DUPLICATE_ADDRESS_PROBE_TIMEOUT = std::chrono::milliseconds(500);
+
+static void sendSolicitation(const Interface &from, Interface &to, const Tins::IPv6Address &target, const char *reason) {
+    auto newPacket = makeNeighborSolicitation(to, target);
+    to.send(newPacket, Metrics::NS);
+
+    LOGGER_VERBOSE("{}, NS from [{}] to [{}]: {}", reason, from.name, to.name, target);
+}
+
+void Sniffer::solicit(std::shared_ptr<Interface> from, const Tins::IPv6Address &target, const char *reason) {
+    // A fallback is already scheduled, it covers this one
+    if (pendingFallbacks.count(target)) return;
+
+    if (LocationHistory::isEnabled() && Interface::interfaces.size() > 2) {
+        if (auto likely = LocationHistory::guess(target); likely && likely != from && likely->up) {
+            Metrics::nsTargeted.increment();
+            sendSolicitation(*from, *likely, target, reason);
+
+            // Solicit the others if the target isn't found on the likely interface in time
+            pendingFallbacks.insert(target);
+            Clock::schedule(LocationHistory::getFallbackTimeout(), [from, likely, target, reason] {
+                pendingFallbacks.erase(target);
+                if (RouteManager::getRoute(target)) return;
+
+                LOGGER_VERBOSE("{} not found on [{}], soliciting all interfaces", target, likely->name);
+                Metrics::nsFallback.increment();
+                for (const auto &[name, forwardTo] : Interface::interfaces)
+                    if (forwardTo != from && forwardTo != likely && forwardTo->up) sendSolicitation(*from, *forwardTo, target, reason);
+            });
+            return;
+        }
+    }
+
+    for (const auto &[name, forwardTo] : Interface::interfaces)
+        if (forwardTo != from && forwardTo->up) sendSolicitation(*from, *forwardTo, target, reason);
+}
+
+static void defendAddress(Interface &interface, const Tins::IPv6Address &target, const Interface &onInterface) {
+    auto newPacket = makeNeighborAdvertisement(interface, ALL_NODES_MAC, ALL_NODES, target, false);
+    interface.send(newPacket, Metrics::NA);
+    Metrics::dadDefended.increment();
+
+    LOGGER_INFO("DAD for {} from [{}] answered, in use on [{}]", target, interface.name, onInterface.name);
+}
+
+void Sniffer::proxyDuplicateAddressDetection(std::shared_ptr<Interface> interface, const Tins::IPv6Address &target, PacketTrace &trace) {
+    trace.mark(PacketTrace::DECIDED);
+
+    auto route = RouteManager::lookupRoute(target);
+    if (route && route->interface->up) {
+        auto onInterface = route->interface;
+        // On the same segment, the host there defends the address itself
+        if (onInterface == interface) return;
+
+        // In use on another segment, defend it for the host there
+        if (Clock::now() - route->lastSeen <= DUPLICATE_ADDRESS_CONFIRMED_RECENTLY) {
+            defendAddress(*interface, target, *onInterface);
+            trace.mark(PacketTrace::RESPONDED);
+            trace.setOutcome(PacketTrace::REPLIED);
+            return;
+        }
+
+        // The route may be stale, the host roaming here with the same address. Defend it only if the
+        // host still answers there before DAD is over
+        if (!pendingDuplicateAddressDetections.insert(target).second) return;
+
+        auto probeTime = Clock::now();
+        auto newPacket = makeNeighborSolicitation(*onInterface, target);
+        onInterface->send(newPacket, Metrics::NS);
+        trace.mark(PacketTrace::RESPONDED);
+        trace.setOutcome(PacketTrace::PROBED);
+        LOGGER_VERBOSE("DAD for {} from [{}], probing it on [{}] first", target, interface->name, onInterface->name);
+
+        Clock::schedule(DUPLICATE_ADDRESS_PROBE_TIMEOUT, [interface, onInterface, target, probeTime] {
+            auto route = RouteManager::lookupRoute(target);
+            if (route && route->interface == onInterface && route->lastSeen >= probeTime) {
+                pendingDuplicateAddressDetections.erase(target);
+                if (interface->up) defendAddress(*interface, target, *onInterface);
+                return;
+            }
+
+            // Not there anymore, the host takes the address here once DAD is over
+            Clock::schedule(DUPLICATE_ADDRESS_DETECTION_TIMEOUT - DUPLICATE_ADDRESS_PROBE_TIMEOUT, [interface, onInterface, target] {
+                pendingDuplicateAddressDetections.erase(target);
+                auto route = RouteManager::lookupRoute(target);
+                if (!interface->up || (route && (route->interface != onInterface || route->pinned))) return;
+
+                if (route) {
+                    LOGGER_INFO("host {} moved from interface [{}] to [{}], seen in DAD", target, onInterface->name, interface->name);
+                    Metrics::routesMoved.increment();
+                    RouteManager::removeRoute(target);
+                }
+                if (!RouteManager::addProvisionalRoute(target, interface)) return;
+
+                LOGGER_VERBOSE("DAD for {} completed on [{}], learned provisionally", target, interface->name);
+                Metrics::dadLearned.increment();
+            });
+        });
+        return;
+    }
+
+    // Forward once, the retransmissions are covered. A host owning the address on another segment
+    // answers to all nodes there, and the NA is learned and forwarded back as any multicast NA
+    if (!pendingDuplicateAddressDetections.insert(target).second) return;
+
+    Metrics::dadForwarded.increment();
+    for (const auto &[name, forwardTo] : Interface::interfaces) {
+        if (forwardTo == interface || !forwardTo->up) continue;
+
+        auto newPacket = makeDuplicateAddressDetection(*forwardTo, target);
+        forwardTo->send(newPacket, Metrics::NS);
+
+        LOGGER_VERBOSE("DAD forwarded from [{}] to [{}]: {}", interface->name, forwardTo->name, target);
+    }
+    trace.mark(PacketTrace::RESPONDED);
+    trace.setOutcome(PacketTrace::FORWARDED);
 
-Queue<std::pair<const std::shared_ptr<Interface>, std::unique_ptr<Tins::PDU>>> Sniffer::queue;
+    // Without a conflict, the host takes the address once DAD is over
+    Clock::schedule(DUPLICATE_ADDRESS_DETECTION_TIMEOUT, [interface, target] {
+        pendingDuplicateAddressDetections.erase(target);
+        if (!interface->up || !RouteManager::addProvisionalRoute(target, interface)) return;
 
-void Sniffer::onPacket(std::shared_ptr<Interface> interface, Tins::PDU &pdu) {
+        LOGGER_VERBOSE("DAD for {} completed on [{}], learned provisionally", target, interface->name);
+        Metrics::dadLearned.increment();
+    });
+}
+
+void Sniffer::onPacket(std::shared_ptr<Interface> interface, Tins::PDU &pdu, PacketTrace &trace) {
     auto &eth = pdu.rfind_pdu<Tins::EthernetII>();
     auto &ip6 = pdu.rfind_pdu<Tins::IPv6>();
     auto &icmp6 = pdu.rfind_pdu<Tins::ICMPv6>();
 
-    Logger::debug("packet from {}", interface->name);
-    Logger::debug("ETH {} -> {}", eth.src_addr(), eth.dst_addr());
-    Logger::debug("IP6 {} -> {}", ip6.src_addr(), ip6.dst_addr());
+    LOGGER_DEBUG("packet from {}", interface->name);
+    LOGGER_DEBUG("ETH {} -> {}", eth.src_addr(), eth.dst_addr());
+    LOGGER_DEBUG("IP6 {} -> {}", ip6.src_addr(), ip6.dst_addr());
 
     if (icmp6.type() == Tins::ICMPv6::NEIGHBOUR_SOLICIT || icmp6.type() == Tins::ICMPv6::NEIGHBOUR_ADVERT) {
+        auto type = icmp6.type() == Tins::ICMPv6::NEIGHBOUR_SOLICIT ? Metrics::NS : Metrics::NA;
+        interface->metrics->received[type].increment();
+        trace.setType(type);
+
+        // Remember where the sender is. Link-local targets don't pass the pcap filter, but NS from
+        // link-local sources do, which gives their interface IDs
+        if (LocationHistory::isEnabled()) {
+            auto address = type == Metrics::NS ? ip6.src_addr() : icmp6.target_addr();
+            if (address != UNSPECIFIED) LocationHistory::record(address, eth.src_addr(), interface);
+        }
+
         // Ignore link-local address 
         if (isLinkLocal(icmp6.target_addr())) {
-            Logger::debug("link-local address {} ignored", icmp6.target_addr());
+            LOGGER_DEBUG("link-local address {} ignored", icmp6.target_addr());
+            Metrics::linkLocalIgnored.increment();
             return;
         }
 
         if (icmp6.type() == Tins::ICMPv6::NEIGHBOUR_SOLICIT) {
-            Logger::verbose("NS target {}", icmp6.target_addr());
-            for (auto option : icmp6.options()) {
-                Logger::debug("NS Option {}: {}", (int)option.option(), toHex(option.data_ptr(), option.data_size()));
+            LOGGER_VERBOSE("NS target {}", icmp6.target_addr());
+            if (Logger::isEnabled(Logger::DEBUG)) {
+                for (const auto &option : icmp6.options())
+                    LOGGER_DEBUG("NS Option {}: {}", (int)option.option(), toHex(option.data_ptr(), option.data_size()));
+            }
+
+            if (ip6.src_addr() == UNSPECIFIED) {
+                LOGGER_VERBOSE("DAD for {} from [{}]", icmp6.target_addr(), interface->name);
+                proxyDuplicateAddressDetection(interface, icmp6.target_addr(), trace);
+                return;
             }
 
             auto onInterface = RouteManager::getRoute(icmp6.target_addr());
-            if (onInterface && onInterface != interface) {
+            // The route is suspended, look for the host elsewhere
+            if (onInterface && !onInterface->up) onInterface = nullptr;
+            trace.mark(PacketTrace::DECIDED);
+            if (onInterface && onInterface != interface && kernelProxy) {
+                // Answered by the kernel already
+                Metrics::nsKernelAnswered.increment();
+                trace.setOutcome(PacketTrace::IGNORED);
+            } else if (onInterface && onInterface != interface) {
                 // Reply
                 auto newPacket = makeNeighborAdvertisement(*interface, eth.src_addr(), ip6.src_addr(), icmp6.target_addr(), true);
-                Tins::PacketSender(interface->tinsInterface).send(newPacket);
+                interface->send(newPacket, Metrics::NA);
+                Metrics::nsReplied.increment();
+                trace.mark(PacketTrace::RESPONDED);
+                trace.setOutcome(PacketTrace::REPLIED);
                 
-                Logger::verbose("NS replied with unicast NA");
+                LOGGER_VERBOSE("NS replied with unicast NA");
             } else if (!onInterface) {
                 // Save to request manager for later respond
                 RequestManager::addRequest(
@@ -53,44 +217,55 @@ void Sniffer::onPacket(std::shared_ptr<Interface> interface, Tins::PDU &pdu) {
                 );
 
                 // Forward NS to other interfaces
-                for (const auto &[name, forwardTo] : Interface::interfaces) {
-                    if (forwardTo == interface) continue;
-
-                    auto newPacket = makeNeighborSolicitation(*forwardTo, icmp6.target_addr());
-                    Tins::PacketSender(forwardTo->tinsInterface).send(newPacket);
-
-                    Logger::verbose("NS forwarded from [{}] to [{}]: {}", interface->name, forwardTo->name, icmp6.target_addr());
-                }
+                Metrics::nsForwarded.increment();
+                solicit(interface, icmp6.target_addr(), "NS forwarded");
+                trace.mark(PacketTrace::RESPONDED);
+                trace.setOutcome(PacketTrace::FORWARDED);
             }
         } else {
-            Logger::verbose("NA target {}", icmp6.target_addr());
-            for (auto option : icmp6.options()) {
-                Logger::debug("NA Option {}: {}", (int)option.option(), toHex(option.data_ptr(), option.data_size()));
+            LOGGER_VERBOSE("NA target {}", icmp6.target_addr());
+            if (Logger::isEnabled(Logger::DEBUG)) {
+                for (const auto &option : icmp6.options())
+                    LOGGER_DEBUG("NA Option {}: {}", (int)option.option(), toHex(option.data_ptr(), option.data_size()));
             }
 
-            RouteManager::addOrRefreshRoute(icmp6.target_addr(), interface);
+            // The target link-layer address groups the addresses of a host
+            std::optional<Tins::HWAddress<6>> macAddress;
+            if (auto option = icmp6.search_option(Tins::ICMPv6::TARGET_ADDRESS); option && option->data_size() == Tins::HWAddress<6>::address_size)
+                macAddress = Tins::HWAddress<6>(option->data_ptr());
+
+            trace.mark(PacketTrace::DECIDED);
+            auto added = RouteManager::addOrRefreshRoute(icmp6.target_addr(), interface, macAddress);
+            trace.mark(PacketTrace::ROUTE_PROGRAMMED);
+            trace.setOutcome(added ? PacketTrace::LEARNED : PacketTrace::REFRESHED);
 
             // Forward multicast NA to other interfaces
             if (ip6.dst_addr().is_multicast()) {
+                Metrics::naForwarded.increment();
                 for (const auto &[name, forwardTo] : Interface::interfaces) {
-                    if (forwardTo == interface) continue;
+                    if (forwardTo == interface || !forwardTo->up) continue;
 
                     auto newPacket = makeNeighborAdvertisement(*interface, eth.dst_addr(), ip6.dst_addr(), icmp6.target_addr(), false);
-                    Tins::PacketSender(forwardTo->tinsInterface).send(newPacket);
+                    forwardTo->send(newPacket, Metrics::NA);
 
-                    Logger::verbose("multicast NA forwarded from [{}] to [{}]: {}", interface->name, forwardTo->name, icmp6.target_addr());
+                    LOGGER_VERBOSE("multicast NA forwarded from [{}] to [{}]: {}", interface->name, forwardTo->name, icmp6.target_addr());
                 }
             }
 
             // Reply to earlier requests
             RequestManager::matchAndRespond(icmp6.target_addr(), [&] (Tins::HWAddress<6> sourceMacAddress, Tins::IPv6Address sourceAddress, std::shared_ptr<Interface> fromInterface) {
                 auto newPacket = makeNeighborAdvertisement(*fromInterface, sourceMacAddress, sourceAddress, icmp6.target_addr(), true);
-                Tins::PacketSender(fromInterface->tinsInterface).send(newPacket);
+                fromInterface->send(newPacket, Metrics::NA);
+               
+                trace.mark(PacketTrace::RESPONDED);
                
-                Logger::info("responded NA to NS for {} from [{}] {}", icmp6.target_addr(), interface->name, sourceAddress);
+                LOGGER_INFO("responded NA to NS for {} from [{}] {}", icmp6.target_addr(), interface->name, sourceAddress);
             });
         }
     } else if (icmp6.type() == Tins::ICMPv6::DEST_UNREACHABLE) {
+        interface->metrics->received[Metrics::DU].increment();
+        trace.setType(Metrics::DU);
+
         auto &raw = icmp6.rfind_pdu<Tins::RawPDU>();
         auto payload = raw.payload();
 
@@ -100,7 +275,7 @@ void Sniffer::onPacket(std::shared_ptr<Interface> interface, Tins::PDU &pdu) {
         constexpr size_t DU_PAYLOAD_START_TARGET = 24;
 
         if (payload.size() < DU_PAYLOAD_START_TARGET + Tins::IPv6Address::address_size) {
-            Logger::warning("malformed DU packet: {}", toHex(payload.data(), payload.size()));
+            LOGGER_WARNING("malformed DU packet: {}", toHex(payload.data(), payload.size()));
             return;
         }
 
@@ -108,99 +283,189 @@ void Sniffer::onPacket(std::shared_ptr<Interface> interface, Tins::PDU &pdu) {
         
         // Ignore link-local address 
         if (isLinkLocal(target)) {
-            Logger::debug("link-local address {} ignored", target);
+            LOGGER_DEBUG("link-local address {} ignored", target);
+            Metrics::linkLocalIgnored.increment();
             return;
         }
 
         auto code = icmp6.code();
-        Logger::verbose("DU code {}, target {}", code, target);
-
-        for (const auto &[name, forwardTo] : Interface::interfaces) {
-            if (forwardTo == interface) continue;
-
-            auto newPacket = makeNeighborSolicitation(*forwardTo, target);
-            Tins::PacketSender(forwardTo->tinsInterface).send(newPacket);
+        LOGGER_VERBOSE("DU code {}, target {}", code, target);
+        Metrics::duProbed.increment();
+        trace.mark(PacketTrace::DECIDED);
 
-            Logger::verbose("DU sending new NS from [{}] to [{}]: {}", interface->name, forwardTo->name, target);
-        }
+        solicit(interface, target, "DU probing");
+        trace.mark(PacketTrace::RESPONDED);
+        trace.setOutcome(PacketTrace::PROBED);
     }
 }
 
-void Sniffer::initialize() {
+std::string Sniffer::getFilterExceptLocalMacAddresses() {
     std::string filterLocalMacAddresses;
     for (auto [_, interface] : Interface::interfaces) {
         if (!filterLocalMacAddresses.empty()) filterLocalMacAddresses += " or ";
-        filterLocalMacAddresses += fmt::format("ether src {}", interface->tinsInterface.hw_address());
+        filterLocalMacAddresses += fmt::format("ether src {}", interface->macAddress);
+    }
+    return fmt::format("not ({})", filterLocalMacAddresses);
+}
+
+std::string Sniffer::getFilterTarget(size_t offset) {
+    // Link-local targets are ignored anyway, their interface IDs are learned from the sources of NS
+    auto filter = fmt::format("ip6[{}:2] != 0xfe80", offset);
+
+    // Compare the prefixes word by word, as a BPF load is 4 bytes at most
+    std::string filterPrefixes;
+    for (const auto &prefix : prefixes) {
+        std::string filterPrefix;
+        auto p = prefix.address.begin();
+        for (size_t bit = 0; bit < prefix.length; bit += 32) {
+            auto i = bit / 8;
+            uint32_t word = (uint32_t)p[i] << 24 | (uint32_t)p[i + 1] << 16 | (uint32_t)p[i + 2] << 8 | p[i + 3];
+            auto bits = std::min<size_t>(prefix.length - bit, 32);
+            uint32_t mask = bits == 32 ? 0xffffffff : ~(0xffffffffu >> bits);
+
+            if (!filterPrefix.empty()) filterPrefix += " and ";
+            if (bits == 32)
+                filterPrefix += fmt::format("ip6[{}:4] = 0x{:08x}", offset + i, word);
+            else
+                filterPrefix += fmt::format("ip6[{}:4] & 0x{:08x} = 0x{:08x}", offset + i, mask, word & mask);
+        }
+
+        // ::/0 takes every target
+        if (filterPrefix.empty()) {
+            filterPrefixes.clear();
+            break;
+        }
+        if (!filterPrefixes.empty()) filterPrefixes += " or ";
+        filterPrefixes += fmt::format("({})", filterPrefix);
     }
-    auto filterExceptLocalMacAddresses = fmt::format("not ({})", filterLocalMacAddresses);
 
+    if (!filterPrefixes.empty()) filter += fmt::format(" and ({})", filterPrefixes);
+    return filter;
+}
+
+void Sniffer::initialize(bool startCapturing) {
+    Metrics::registerGauge("magpie_queue_depth", [] { return queue.size(); });
+
+    if (startCapturing) startCaptures();
+}
+
+void Sniffer::setKernelProxy(bool enabled) {
+    kernelProxy = enabled;
+}
+
+bool Sniffer::setTargetFilter(const std::vector<IPv6Prefix> &prefixes) {
+    auto previous = getFilterTarget(0);
+    Sniffer::prefixes = prefixes;
+    return getFilterTarget(0) != previous;
+}
+
+void Sniffer::startCaptures() {
+    capturing = true;
+    auto filterExceptLocalMacAddresses = getFilterExceptLocalMacAddresses();
     for (auto [_, interface] : Interface::interfaces)
         startOnInterface(interface, filterExceptLocalMacAddresses);
 
     startOnInterface(Interface::getLoopback(), "");
 }
 
-void Sniffer::startOnInterface(std::shared_ptr<Interface> interface, const std::string &filterExceptLocalMacAddresses) {
-    std::mutex mutex;
-    std::condition_variable cv;
-    bool started = false;
-
-    std::thread([&, interface] {
-        auto macAddress = interface->tinsInterface.hw_address().to_string();
-        Logger::info("listening on interface: {} [{}]", interface->name, macAddress);
-
-        constexpr auto FILTER = (
-            "icmp6 and ("
-                // NS or NA, NOT send from this host
-                "((ip6[40] = 135 or ip6[40] = 136) and {0}) or "
-                // DU (0 "No route to destination" and 3 "Address unreachable"), send from this host
-                "((ip6[40] = 1 and (ip6[41] = 0 or ip6[41] = 3)) and ether src {1})"
-            ")"
-        );
-        constexpr auto FILTER_LO = (
-            "icmp6 and ("
-                // DU (0 "No route to destination" and 3 "Address unreachable")
-                "ip6[40] = 1 and (ip6[41] = 0 or ip6[41] = 3)"
-            ")"
-        );
-
-        auto filter =
-            interface->name == "lo"
-            ? FILTER_LO
-            : fmt::format(FILTER, filterExceptLocalMacAddresses, macAddress);
-        Logger::info("pcap filter '{}'", filter);
-
-        Tins::Sniffer sniffer(interface->name);
-        ENSURE(sniffer.set_filter(filter));
-
-        // Notify started
-        {
-            std::lock_guard lock(mutex);
-            started = true;
-            cv.notify_one();
-        }
+void Sniffer::stopCaptures() {
+    capturing = false;
+    for (auto [_, interface] : Interface::interfaces)
+        if (interface->capture) interface->capture->stop();
 
-        // Enter loop
-        sniffer.sniff_loop([&] (Tins::PDU &pdu) {
-            queue.push(std::make_pair(interface, std::unique_ptr<Tins::PDU>(pdu.clone())));
-            return true;
-        });
-    }).detach();
+    if (auto loopback = Interface::getLoopback(); loopback->capture) loopback->capture->stop();
+}
 
-    // Wait for started
-    {
-        std::unique_lock lock(mutex);
-        cv.wait(lock, [&] { return started; });
-    }
+bool Sniffer::isCapturing() {
+    return capturing;
+}
+
+void Sniffer::restartCapture(std::shared_ptr<Interface> interface) {
+    if (!interface->capture || !capturing) return;
+
+    // The captures of the other interfaces keep their filters, with the old local MAC address
+    interface->capture->stop(*interface);
+    startOnInterface(interface, getFilterExceptLocalMacAddresses());
+}
+
+void Sniffer::startOnInterface(std::shared_ptr<Interface> interface, const std::string &filterExceptLocalMacAddresses) {
+    if (!interface->capture) return;
+
+    auto macAddress = interface->macAddress.to_string();
+    LOGGER_INFO("listening on interface: {} [{}]", interface->name, macAddress);
+
+    // The target of NS and NA follows the 8 bytes of ICMPv6 header, and the one of DU is the
+    // destination of the original packet after them
+    constexpr size_t NDP_TARGET_OFFSET = 40 + 8;
+    constexpr size_t DU_TARGET_OFFSET = 40 + 8 + 24;
+    auto filterNdpTarget = getFilterTarget(NDP_TARGET_OFFSET);
+    auto filterDuTarget = getFilterTarget(DU_TARGET_OFFSET);
+    if (!filterNdpTarget.empty()) filterNdpTarget = " and " + filterNdpTarget;
+    if (!filterDuTarget.empty()) filterDuTarget = " and " + filterDuTarget;
+
+    constexpr auto FILTER = (
+        "icmp6 and ("
+            // NS or NA, NOT send from this host
+            "((ip6[40] = 135 or ip6[40] = 136) and {0}{2}) or "
+            // DU (0 "No route to destination" and 3 "Address unreachable"), send from this host
+            "((ip6[40] = 1 and (ip6[41] = 0 or ip6[41] = 3)) and ether src {1}{3})"
+        ")"
+    );
+    constexpr auto FILTER_LO = (
+        "icmp6 and ("
+            // DU (0 "No route to destination" and 3 "Address unreachable")
+            "ip6[40] = 1 and (ip6[41] = 0 or ip6[41] = 3){0}"
+        ")"
+    );
+
+    auto filter =
+        interface->name == "lo"
+        ? fmt::format(FILTER_LO, filterDuTarget)
+        : fmt::format(FILTER, filterExceptLocalMacAddresses, macAddress, filterNdpTarget, filterDuTarget);
+    LOGGER_INFO("pcap filter '{}'", filter);
+
+    interface->capture->start(interface, filter, [interface] (std::unique_ptr<Tins::PDU> pdu, int64_t captureTime) {
+        queue.push(QueueItem{interface, std::move(pdu), captureTime, nullptr});
+    });
+}
+
+void Sniffer::post(std::function<void ()> task) {
+    queue.push(QueueItem{nullptr, nullptr, 0, std::move(task)});
 }
 
 void Sniffer::mainLoop() {
     while (true) {
-        auto [interface, pdu] = queue.pop();
-        try {
-            onPacket(interface, *pdu);
-        } catch (const Tins::pdu_not_found &e) {
-            Logger::error("failed to decode packet with tins: {}", e.what());
+        Clock::runDue();
+
+        // Wait for a packet or task until the next timer is due
+        std::optional<QueueItem> item;
+        if (auto nextDue = Clock::getNextDue())
+            item = queue.pop(*nextDue);
+        else
+            item = queue.pop();
+        if (!item) continue;
+
+        auto &[interface, pdu, captureTime, task] = *item;
+        if (task) {
+            task();
+            continue;
         }
+
+        // Captured before the interface went down or was removed, or the captures were stopped
+        if (!interface->up || !capturing) continue;
+
+        process(interface, *pdu, captureTime);
+    }
+}
+
+void Sniffer::process(std::shared_ptr<Interface> interface, Tins::PDU &pdu, int64_t captureTime) {
+    PacketTrace trace(captureTime);
+    trace.mark(PacketTrace::DEQUEUED);
+    try {
+        onPacket(interface, pdu, trace);
+    } catch (const Tins::pdu_not_found &e) {
+        LOGGER_ERROR("failed to decode packet with tins: {}", e.what());
+        Metrics::decodeErrors.increment();
     }
+    trace.finish(interface->name);
 }
@@ -2,18 +2,64 @@
 
 #include <string>
 #include <memory>
+#include <functional>
+#include <vector>
+#include <unordered_set>
 #include <tins/tins.h>
 
 #include "Queue.h"
 #include "Interface.h"
+#include "PacketTrace.h"
+#include "Utils.h"
 
 class Sniffer {
-    static Queue<std::pair<const std::shared_ptr<Interface>, std::unique_ptr<Tins::PDU>>> queue;
+    // A captured packet, or a task posted to run on the main loop
+    struct QueueItem {
+        std::shared_ptr<Interface> interface;
+        std::unique_ptr<Tins::PDU> pdu;
+        // Kernel capture timestamp, in microseconds since epoch
+        int64_t captureTime;
+        std::function<void ()> task;
+    };
 
-    static void onPacket(std::shared_ptr<Interface> interface, Tins::PDU &pdu);
+    static Queue<QueueItem> queue;
+    // Targets solicited on their likely interface, waiting to fall back to all interfaces
+    static std::unordered_set<Tins::IPv6Address> pendingFallbacks;
+    // Targets of DAD forwarded to the other interfaces, until DAD is over
+    static std::unordered_set<Tins::IPv6Address> pendingDuplicateAddressDetections;
+    // NS for known routes are answered by the kernel from proxy neighbor entries
+    inline static bool kernelProxy = false;
+    // Packets captured while stopped, e.g. queued already or on a trunk, are dropped
+    inline static bool capturing = false;
+    // Only NS, NA and DU for targets in these prefixes are captured, all if empty
+    inline static std::vector<IPv6Prefix> prefixes;
+
+    static void onPacket(std::shared_ptr<Interface> interface, Tins::PDU &pdu, PacketTrace &trace);
+    // Solicit the target on the interfaces other than the one it was asked from
+    static void solicit(std::shared_ptr<Interface> from, const Tins::IPv6Address &target, const char *reason);
+    // Answer DAD for an address in use on another interface, or forward it and learn the host after
+    static void proxyDuplicateAddressDetection(std::shared_ptr<Interface> interface, const Tins::IPv6Address &target, PacketTrace &trace);
+    static std::string getFilterExceptLocalMacAddresses();
+    // The condition on the target address at the offset of the IPv6 packet, link-local ones rejected
+    static std::string getFilterTarget(size_t offset);
     static void startOnInterface(std::shared_ptr<Interface> interface, const std::string &filterExceptLocalMacAddresses);
 
 public:
-    static void initialize();
+    static void initialize(bool startCapturing);
+    // Leave NS for known routes to the kernel, only learning and unknown targets are handled here
+    static void setKernelProxy(bool enabled);
+    // Filter the targets in the kernel, returns whether the filter changed. The captures started
+    // already keep the old one until restarted
+    static bool setTargetFilter(const std::vector<IPv6Prefix> &prefixes);
+    // (Re)start capturing an interface added or re-created at runtime
+    static void restartCapture(std::shared_ptr<Interface> interface);
+    // Stop all captures and start them again, around handing over to another process
+    static void stopCaptures();
+    static void startCaptures();
+    static bool isCapturing();
     static void mainLoop();
+    // Run the task on the main loop, serialized with packet processing
+    static void post(std::function<void ()> task);
+    // Process one captured packet, on the main loop unless nothing else is running
+    static void process(std::shared_ptr<Interface> interface, Tins::PDU &pdu, int64_t captureTime);
 };
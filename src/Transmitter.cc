@@ -0,0 +1,8 @@
+#include "Transmitter.h"
+
+#include "Interface.h"
+
+void TinsTransmitter::send(const Interface &interface, Tins::PDU &packet) {
+    // Only called on the main loop, timers included, so the socket is kept between calls
+    sender.send(packet, interface.tinsInterface);
+}
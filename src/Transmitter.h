@@ -0,0 +1,21 @@
+#pragma once
+
+#include <tins/tins.h>
+
+struct Interface;
+
+// Sends packets out of an interface. The default writes to the interface with a raw socket,
+// other implementations are used to run the processing logic without real interfaces.
+class Transmitter {
+public:
+    virtual ~Transmitter() = default;
+
+    virtual void send(const Interface &interface, Tins::PDU &packet) = 0;
+};
+
+class TinsTransmitter : public Transmitter {
+    Tins::PacketSender sender;
+
+public:
+    void send(const Interface &interface, Tins::PDU &packet) override;
+};
@@ -1,21 +1,25 @@
 #include <cstdio>
+#include <sstream>
+#include <sched.h>
 
 #include "Utils.h"
 
 std::string toHex(const void *ptr, size_t size) {
+    constexpr char DIGITS[] = "0123456789abcdef";
     auto sptr = static_cast<const unsigned char *>(ptr);
 
     std::string result(size * 2, '0');
-    for (size_t i = 0; i < size; i++)
-        sprintf(&result[i * 2], "%02x", sptr[i]);
+    for (size_t i = 0; i < size; i++) {
+        result[i * 2] = DIGITS[sptr[i] >> 4];
+        result[i * 2 + 1] = DIGITS[sptr[i] & 0xf];
+    }
     return result;
 }
 
-Tins::IPv6Address getLinkLocal(const Tins::NetworkInterface &interface) {
+Tins::IPv6Address getLinkLocal(const Tins::HWAddress<6> &mac) {
     const static auto LINK_LOCAL_TEMPLATE = Tins::IPv6Address("fe80::AABB:CCff:feDD:EEFF");
 
     auto ip = LINK_LOCAL_TEMPLATE;
-    auto mac = interface.hw_address();
 
     *(ip.end() - 1) = *(mac.end() - 1);
     *(ip.end() - 2) = *(mac.end() - 2);
@@ -32,3 +36,63 @@ bool isLinkLocal(const Tins::IPv6Address &address) {
     auto p = address.begin();
     return p[0] == 0xfe && p[1] == 0x80;
 }
+
+bool IPv6Prefix::contains(const Tins::IPv6Address &address) const {
+    auto p = this->address.begin(), q = address.begin();
+    size_t fullBytes = length / 8, remainingBits = length % 8;
+    for (size_t i = 0; i < fullBytes; i++)
+        if (p[i] != q[i]) return false;
+
+    if (remainingBits == 0) return true;
+    uint8_t mask = 0xff << (8 - remainingBits);
+    return (p[fullBytes] & mask) == (q[fullBytes] & mask);
+}
+
+std::optional<Tins::IPv6Address> parseAddress(const std::string &str) {
+    try {
+        return Tins::IPv6Address(str);
+    } catch (const std::exception &) {
+        return std::nullopt;
+    }
+}
+
+std::optional<IPv6Prefix> parsePrefix(const std::string &str) {
+    auto slash = str.find('/');
+    auto address = parseAddress(str.substr(0, slash));
+    if (!address) return std::nullopt;
+    if (slash == std::string::npos) return IPv6Prefix{*address, Tins::IPv6Address::address_size * 8};
+
+    size_t length;
+    try {
+        size_t end;
+        length = std::stoul(str.substr(slash + 1), &end);
+        if (end != str.length() - slash - 1) return std::nullopt;
+    } catch (const std::exception &) {
+        return std::nullopt;
+    }
+    if (length > Tins::IPv6Address::address_size * 8) return std::nullopt;
+
+    return IPv6Prefix{*address, length};
+}
+
+std::optional<std::vector<int>> parseCpuList(const std::string &str) {
+    std::vector<int> cpus;
+    std::stringstream stream(str);
+    for (std::string range; std::getline(stream, range, ','); ) {
+        int first, last;
+        char dash;
+        std::istringstream rangeStream(range);
+        if (!(rangeStream >> first) || first < 0) return std::nullopt;
+        if (rangeStream >> dash) {
+            if (dash != '-' || !(rangeStream >> last) || last < first) return std::nullopt;
+        } else {
+            last = first;
+        }
+        if (!rangeStream.eof() || last >= CPU_SETSIZE) return std::nullopt;
+
+        for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+    }
+
+    if (cpus.empty()) return std::nullopt;
+    return cpus;
+}
@@ -1,9 +1,23 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <optional>
 
 #include <tins/tins.h>
 
+struct IPv6Prefix {
+    Tins::IPv6Address address;
+    size_t length;
+
+    bool contains(const Tins::IPv6Address &address) const;
+};
+
 std::string toHex(const void *ptr, size_t size);
-Tins::IPv6Address getLinkLocal(const Tins::NetworkInterface &interface);
+Tins::IPv6Address getLinkLocal(const Tins::HWAddress<6> &mac);
 bool isLinkLocal(const Tins::IPv6Address &address);
+std::optional<Tins::IPv6Address> parseAddress(const std::string &str);
+// Parse "addr/len", or a single address as a /128
+std::optional<IPv6Prefix> parsePrefix(const std::string &str);
+// Parse a CPU list like "0,2-3"
+std::optional<std::vector<int>> parseCpuList(const std::string &str);
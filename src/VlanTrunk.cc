@@ -0,0 +1,188 @@
+#include "VlanTrunk.h"
+
+#include <mutex>
+#include <algorithm>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <condition_variable>
+#include <fmt/format.h>
+
+#include "Ensure/Ensure.h"
+#include "Logger.h"
+#include "Scheduling.h"
+#include "Interface.h"
+
+void TrunkCapture::addMember(const std::string &name, uint16_t vlanId) {
+    memberVlans[name] = vlanId;
+}
+
+void TrunkCapture::removeMember(const std::string &name) {
+    memberVlans.erase(name);
+}
+
+void TrunkCapture::setHandler(uint16_t vlanId, Handler handler) {
+    std::lock_guard lock(mutex);
+    auto newHandlers = std::make_shared<std::unordered_map<uint16_t, Handler>>(*handlers);
+    if (handler) (*newHandlers)[vlanId] = std::move(handler);
+    else newHandlers->erase(vlanId);
+    handlers = std::move(newHandlers);
+}
+
+void TrunkCapture::start(std::shared_ptr<Interface> interface, const std::string &filter, Handler handler) {
+    setHandler(memberVlans.at(interface->name), std::move(handler));
+    filters[interface->name] = filter;
+    if (!allStarted && filters.size() < memberVlans.size()) return;
+
+    allStarted = true;
+    restartOnParent();
+}
+
+void TrunkCapture::stop() {
+    stopOnParent();
+    allStarted = false;
+}
+
+void TrunkCapture::stop(const Interface &interface) {
+    if (auto it = memberVlans.find(interface.name); it != memberVlans.end()) setHandler(it->second, nullptr);
+    filters.erase(interface.name);
+    if (allStarted) restartOnParent();
+}
+
+void TrunkCapture::restartOnParent() {
+    if (filters.empty()) {
+        stopOnParent();
+        return;
+    }
+
+    // The filters of the members only differ in the local MAC addresses. "vlan" shifts the offsets
+    // of the following expressions, so it's used only once
+    std::vector<std::string> uniqueFilters;
+    for (const auto &[_, memberFilter] : filters)
+        if (std::find(uniqueFilters.begin(), uniqueFilters.end(), memberFilter) == uniqueFilters.end()) uniqueFilters.push_back(memberFilter);
+    std::string parentFilter = "vlan and (";
+    for (size_t i = 0; i < uniqueFilters.size(); i++)
+        parentFilter += fmt::format("{}({})", i == 0 ? "" : " or ", uniqueFilters[i]);
+    parentFilter += ")";
+
+    if (parentFilter == runningFilter) return;
+    stopOnParent();
+    startOnParent(parentFilter);
+}
+
+void TrunkCapture::stopOnParent() {
+    std::lock_guard lock(mutex);
+    if (stopped) *stopped = true;
+    if (sniffer) sniffer->stop_sniff();
+    runningFilter.clear();
+}
+
+void TrunkCapture::startOnParent(const std::string &filter) {
+    LOGGER_INFO("capturing {} VLANs on trunk {}, pcap filter '{}'", filters.size(), parent, filter);
+    runningFilter = filter;
+
+    std::mutex startMutex;
+    std::condition_variable cv;
+    bool started = false;
+
+    auto stopped = std::make_shared<std::atomic<bool>>(false);
+    {
+        std::lock_guard lock(mutex);
+        this->stopped = stopped;
+    }
+
+    std::thread([&, this, filter, stopped] {
+        auto sniffer = std::make_unique<Tins::Sniffer>(parent);
+        ENSURE(sniffer->set_filter(filter));
+        {
+            std::lock_guard lock(mutex);
+            if (!*stopped) this->sniffer = sniffer.get();
+        }
+        Scheduling::applyToCaptureThread(sniffer->get_fd());
+
+        // Notify started
+        {
+            std::lock_guard lock(startMutex);
+            started = true;
+            cv.notify_one();
+        }
+
+        for (auto &packet : *sniffer) {
+            if (*stopped) break;
+
+            auto dot1q = packet.pdu()->find_pdu<Tins::Dot1Q>();
+            if (!dot1q) continue;
+
+            std::shared_ptr<const std::unordered_map<uint16_t, Handler>> handlers;
+            {
+                std::lock_guard lock(mutex);
+                handlers = this->handlers;
+            }
+            auto it = handlers->find(dot1q->id());
+            if (it == handlers->end()) continue;
+
+            const auto &timestamp = packet.timestamp();
+            it->second(
+                std::unique_ptr<Tins::PDU>(packet.release_pdu()),
+                timestamp.seconds() * 1000000 + timestamp.microseconds()
+            );
+        }
+
+        std::lock_guard lock(mutex);
+        if (this->sniffer == sniffer.get()) this->sniffer = nullptr;
+    }).detach();
+
+    // Wait for started
+    {
+        std::unique_lock lock(startMutex);
+        cv.wait(lock, [&] { return started; });
+    }
+}
+
+void TrunkTransmitter::send(const Interface &, Tins::PDU &packet) {
+    // Only called on the main loop
+    auto &eth = packet.rfind_pdu<Tins::EthernetII>();
+    auto tagged = Tins::EthernetII(eth.dst_addr(), eth.src_addr()) / Tins::Dot1Q(vlanId) / *eth.inner_pdu();
+    sender.send(tagged, parent);
+}
+
+void VlanTrunk::initialize(const std::string &parent) {
+    VlanTrunk::parent = parent;
+    capture = std::make_shared<TrunkCapture>(parent);
+
+    // "name | VID | parent" after the headers
+    std::ifstream config("/proc/net/vlan/config");
+    if (!config) {
+        LOGGER_ERROR("failed to read /proc/net/vlan/config, is the 8021q module loaded?");
+        exit(1);
+    }
+
+    std::string line;
+    while (std::getline(config, line)) {
+        std::istringstream fields(line);
+        std::string name, separator, device;
+        unsigned vlanId;
+        if (!(fields >> name >> separator >> vlanId >> separator >> device)) continue;
+        if (device == parent) vlans[name] = vlanId;
+    }
+
+    if (vlans.empty())
+        LOGGER_WARNING("no VLAN interfaces found on trunk {}", parent);
+}
+
+bool VlanTrunk::attach(Interface &interface) {
+    if (!capture) return false;
+
+    auto it = vlans.find(interface.name);
+    if (it == vlans.end()) return false;
+
+    LOGGER_INFO("interface {} is VLAN {} of trunk {}", interface.name, it->second, parent);
+    capture->addMember(interface.name, it->second);
+    interface.capture = capture;
+    interface.transmitter = std::make_shared<TrunkTransmitter>(parent, it->second);
+    return true;
+}
+
+void VlanTrunk::detach(const Interface &interface) {
+    if (capture && interface.capture == capture) capture->removeMember(interface.name);
+}
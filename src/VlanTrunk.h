@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <tins/tins.h>
+
+#include "Capture.h"
+#include "Transmitter.h"
+
+struct Interface;
+
+// Captures the 802.1Q sub-interfaces of a trunk once on the parent device, one pcap handle and
+// thread for all, and hands each packet to the sub-interface of its VLAN tag. The capture starts
+// once every member attached has been started, and is restarted with the others when a member
+// changes its filter, joins later by hotplug or reload, or is stopped on its own.
+class TrunkCapture : public Capture {
+    std::string parent;
+    std::unordered_map<std::string, uint16_t> memberVlans;
+    // Replaced, never modified, under the mutex, the capture thread reading a copy of the pointer
+    std::shared_ptr<const std::unordered_map<uint16_t, Handler>> handlers = std::make_shared<std::unordered_map<uint16_t, Handler>>();
+    // Of each member started, by name
+    std::map<std::string, std::string> filters;
+    // The filter of the capture thread, empty if stopped
+    std::string runningFilter;
+    // Every member was started since the trunk was stopped as a whole
+    bool allStarted = false;
+
+    std::mutex mutex;
+    Tins::Sniffer *sniffer = nullptr;
+    // Of the current capture thread
+    std::shared_ptr<std::atomic<bool>> stopped;
+
+    void setHandler(uint16_t vlanId, Handler handler);
+    // Restart on the parent with the filters of the members started, stop if none
+    void restartOnParent();
+    void startOnParent(const std::string &filter);
+    void stopOnParent();
+
+public:
+    TrunkCapture(const std::string &parent) : parent(parent) {}
+
+    void addMember(const std::string &name, uint16_t vlanId);
+    // The member is no longer relayed, stopped already
+    void removeMember(const std::string &name);
+    void start(std::shared_ptr<Interface> interface, const std::string &filter, Handler handler) override;
+    // Stop capturing on the parent for all members, until every one is started again
+    void stop() override;
+    // Stop capturing the member, the others are captured on
+    void stop(const Interface &interface) override;
+};
+
+// Sends as tagged frames on the parent device
+class TrunkTransmitter : public Transmitter {
+    Tins::NetworkInterface parent;
+    uint16_t vlanId;
+    Tins::PacketSender sender;
+
+public:
+    TrunkTransmitter(const std::string &parent, uint16_t vlanId) : parent(parent), vlanId(vlanId) {}
+
+    void send(const Interface &interface, Tins::PDU &packet) override;
+};
+
+class VlanTrunk {
+    inline static std::string parent;
+    inline static std::shared_ptr<TrunkCapture> capture;
+    // Sub-interfaces of the parent by name, with their VLAN IDs
+    inline static std::unordered_map<std::string, uint16_t> vlans;
+
+public:
+    // Read the VLAN devices of the parent from /proc/net/vlan/config
+    static void initialize(const std::string &parent);
+    // Capture and send through the trunk if the interface is one of its VLANs
+    static bool attach(Interface &interface);
+    // The interface is no longer relayed
+    static void detach(const Interface &interface);
+};
@@ -158,8 +158,15 @@ ArgumentParser &ArgumentParser::showHelp() {
     return *this;
 }
 
+ArgumentParser &ArgumentParser::throwOnError() {
+    exitOnError = false;
+    return *this;
+}
+
 ArgumentParser &ArgumentParser::parse() {
     auto raiseError = [&](const std::string &message) {
+        if (!exitOnError) throw std::invalid_argument(message);
+
         std::clog << message << std::endl;
         std::clog << "Try '" << argv[0] << " -?' for more information." << std::endl;
         exit(2); // USAGE
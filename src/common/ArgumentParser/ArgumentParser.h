@@ -9,6 +9,7 @@
 #include <vector>
 #include <functional>
 #include <optional>
+#include <stdexcept>
 
 class ArgumentParser {
 public:
@@ -35,6 +36,7 @@ private:
     std::vector<Argument> positionalArguments;
 
     std::string programDescription;
+    bool exitOnError = true;
 
 public:
     ArgumentParser(int argc, char **argv) : argc((size_t)argc), argv(argv) {}
@@ -95,6 +97,8 @@ public:
                                   bool optional = false,
                                   const std::string &defaultValue = "");
     ArgumentParser &showHelp();
+    // Throw std::invalid_argument with the message on errors, instead of printing it and exiting
+    ArgumentParser &throwOnError();
     ArgumentParser &parse();
 };
 
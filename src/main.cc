@@ -1,4 +1,5 @@
 #include <string>
+#include <thread>
 #include <signal.h>
 #include <tins/tins.h>
 
@@ -8,36 +9,129 @@
 #include "Sniffer.h"
 #include "RouteManager.h"
 #include "NDP.h"
+#include "Metrics.h"
+#include "PacketTrace.h"
+#include "ControlSocket.h"
+#include "LocationHistory.h"
+#include "VlanTrunk.h"
+#include "LinkMonitor.h"
+#include "Reloader.h"
+#include "RequestManager.h"
+#include "Handoff.h"
+#include "Scheduling.h"
+#include "Replication.h"
 
-void exitOnSignal(int) {
-    exit(0);
+static sigset_t handledSignals() {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGQUIT);
+    sigaddset(&signals, SIGHUP);
+    return signals;
+}
+
+// Reload or exit on the main loop, so it never happens in the middle of processing
+static void waitSignals() {
+    std::thread([] {
+        auto signals = handledSignals();
+        while (true) {
+            int signal;
+            if (sigwait(&signals, &signal) != 0) continue;
+
+            if (signal == SIGHUP) {
+                Sniffer::post([] { Reloader::reload(); });
+                continue;
+            }
+
+            LOGGER_INFO("received signal {}, exiting", signal);
+            Sniffer::post([] { exit(0); });
+            return;
+        }
+    }).detach();
 }
 
 int main(int argc, char *argv[]) {
+    // Block the signals before any thread is created, so they're only received by sigwait()
+    auto signals = handledSignals();
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
     auto arguments = parseArguments(argc, argv);
 
-    Logger::initialize(arguments.logLevel);
+    Logger::initialize(arguments.logLevel, arguments.logTarget, arguments.logFile);
+    Scheduling::initialize(
+        arguments.captureCpus,
+        arguments.processingCpus,
+        arguments.realtimePriority,
+        arguments.busyPoll,
+        arguments.lockMemory
+    );
+
+    if (!arguments.trunk.empty())
+        VlanTrunk::initialize(arguments.trunk);
+    if (arguments.hotplug) {
+        // Subscribe first, an interface appearing meanwhile isn't missed
+        LinkMonitor::initialize(arguments.interfaces);
+        for (const auto &interfaceName : arguments.interfaces)
+            if (!Interface::tryInitialize(interfaceName))
+                LOGGER_WARNING("interface {} not found, waiting for it", interfaceName);
+    } else {
+        for (const auto &interfaceName : arguments.interfaces)
+            Interface::initialize(interfaceName);
+    }
+
+    PacketTrace::initialize(arguments.slowPacketThreshold * 1000);
+    LocationHistory::initialize(arguments.locationHistory, std::chrono::milliseconds(arguments.targetedNsTimeout));
+    Sniffer::setTargetFilter(arguments.prefixes);
+    // A standby neither captures nor installs the saved routes, not to answer for the active one
+    if (!arguments.replicationPeer.empty())
+        Replication::initialize(arguments.replicationListen, arguments.replicationPeer, arguments.standby);
+    Sniffer::initialize(!Replication::isStandby());
 
-    for (const auto &interfaceName : arguments.interfaces)
-        Interface::initialize(interfaceName);
+    // Capturing already, so no packet is missed while the running process hands over
+    std::optional<Handoff::State> handedOver;
+    if (!arguments.handoffSocket.empty())
+        handedOver = Handoff::receive(arguments.handoffSocket, arguments.controlSocket, arguments.metricsListen);
+    if (handedOver) {
+        RouteManager::adoptRoutes(handedOver->routes);
+        for (const auto &request : handedOver->requests)
+            RequestManager::adoptRequest(request);
+    }
 
-    Sniffer::initialize();
+    if (!arguments.metricsListen.empty())
+        Metrics::initialize(arguments.metricsListen, handedOver ? handedOver->metricsSocket : -1);
 
-    signal(SIGINT, exitOnSignal);
-    signal(SIGTERM, exitOnSignal);
-    signal(SIGQUIT, exitOnSignal);
-    signal(SIGHUP, exitOnSignal);
+    Reloader::initialize(argc, argv, arguments);
+    waitSignals();
 
+    if (arguments.kernelProxy) {
+        RouteManager::setRouteProgrammer(std::make_unique<ProxyNdpRouteProgrammer>(std::make_unique<IpCommandRouteProgrammer>()));
+        Sniffer::setKernelProxy(true);
+    }
+
+    // Before loading the saved routes, whose age limit allows for the longest interval
+    RouteManager::groupByMacAddress(arguments.macVerifyInterval);
+    RouteManager::adaptProbeInterval(arguments.routeProbeIntervalMin, arguments.routeProbeIntervalMax);
     RouteManager::initialize(
         arguments.alarmInterval,
         arguments.routeProbeInterval,
         arguments.routeProbeRetries,
         arguments.routesSaveFile,
+        arguments.routesSaveFormat,
+        arguments.routesSaveInterval,
+        arguments.warmStart,
+        arguments.warmStartProbeRate,
         [] (Tins::IPv6Address address, std::shared_ptr<Interface> interface) {
             auto newPacket = makeNeighborSolicitation(*interface, address);
-            Tins::PacketSender(interface->tinsInterface).send(newPacket);
+            interface->send(newPacket, Metrics::NS);
         }
     );
 
+    if (!arguments.controlSocket.empty())
+        ControlSocket::initialize(arguments.controlSocket, handedOver ? handedOver->controlSocket : -1);
+    if (!arguments.handoffSocket.empty())
+        Handoff::initialize(arguments.handoffSocket, arguments.controlSocket, arguments.metricsListen);
+
+    Scheduling::applyToProcessingThread();
     Sniffer::mainLoop();
 }